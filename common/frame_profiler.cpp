@@ -0,0 +1,198 @@
+#include "frame_profiler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+namespace {
+
+typedef void (APIENTRY *GenQueriesProc)(GLsizei, GLuint*);
+typedef void (APIENTRY *DeleteQueriesProc)(GLsizei, const GLuint*);
+typedef void (APIENTRY *BeginQueryProc)(GLenum, GLuint);
+typedef void (APIENTRY *EndQueryProc)(GLenum);
+typedef void (APIENTRY *GetQueryObjectivProc)(GLuint, GLenum, GLint*);
+typedef void (APIENTRY *GetQueryObjectui64vProc)(GLuint, GLenum, uint64_t*);
+
+int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Timer queries are core since GL 3.3
+bool hasTimerQueries() {
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    int major = 0, minor = 0;
+    if (version && std::sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 3))) {
+        return true;
+    }
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    return extensions && std::strstr(extensions, "GL_ARB_timer_query");
+}
+
+void printStatistics(std::ostream& out, const char* label, const std::vector<double>& samples) {
+    out << "[PROFILE] " << label << " ms: p50 " << FrameProfiler::percentile(samples, 0.50)
+        << "  p95 " << FrameProfiler::percentile(samples, 0.95)
+        << "  p99 " << FrameProfiler::percentile(samples, 0.99)
+        << "  (" << samples.size() << " samples)" << std::endl;
+}
+
+} // namespace
+
+double FrameProfiler::percentile(std::vector<double> samples, double fraction) {
+    if (samples.empty()) return 0.0;
+    // The epsilon keeps products like 0.95 * 100 = 95.000000000000014 at 95
+    double rank = std::ceil(fraction * samples.size() - 1e-9);
+    size_t index = static_cast<size_t>(std::min(std::max(rank, 1.0), static_cast<double>(samples.size()))) - 1;
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+FrameProfiler::FrameProfiler(GlLoader loader, size_t maxSamples)
+    : maxSamples(std::max<size_t>(1, maxSamples)) {
+    if (loader && hasTimerQueries()) {
+        genQueries = loader("glGenQueries");
+        deleteQueries = loader("glDeleteQueries");
+        beginQuery = loader("glBeginQuery");
+        endQuery = loader("glEndQuery");
+        getQueryObjectiv = loader("glGetQueryObjectiv");
+        getQueryObjectui64v = loader("glGetQueryObjectui64v");
+        timerQueries = genQueries && deleteQueries && beginQuery && endQuery && getQueryObjectiv && getQueryObjectui64v;
+    }
+
+    if (timerQueries) {
+        GLuint queries[queryRingSize];
+        reinterpret_cast<GenQueriesProc>(genQueries)(queryRingSize, queries);
+        for (int i = 0; i < queryRingSize; ++i) ring[i].query = queries[i];
+    }
+}
+
+FrameProfiler::~FrameProfiler() {
+    if (timerQueries) {
+        GLuint queries[queryRingSize];
+        for (int i = 0; i < queryRingSize; ++i) queries[i] = ring[i].query;
+        reinterpret_cast<DeleteQueriesProc>(deleteQueries)(queryRingSize, queries);
+    }
+}
+
+bool FrameProfiler::openCsv(const std::string& path) {
+    csv.open(path, std::ios::trunc);
+    if (!csv) return false;
+    csv << "frame,cpu_submit_ms,gpu_ms\n";
+    return true;
+}
+
+void FrameProfiler::beginFrame() {
+    if (inFrame) endFrame();
+    inFrame = true;
+
+    if (timerQueries) {
+        PendingFrame& slot = ring[ringIndex];
+        // Never wait here: a result that is still not ready after a full
+        // ring of frames is dropped and the query object reused
+        if (slot.inFlight) resolve(slot, false);
+        reinterpret_cast<BeginQueryProc>(beginQuery)(GL_TIME_ELAPSED, slot.query);
+        queryActive = true;
+    }
+
+    frameStartNanoseconds = nowNanoseconds();
+}
+
+void FrameProfiler::endFrame() {
+    if (!inFrame) return;
+    inFrame = false;
+
+    double cpuMilliseconds = (nowNanoseconds() - frameStartNanoseconds) / 1e6;
+    record(cpuSamples, cpuNext, cpuMilliseconds);
+
+    if (queryActive) {
+        reinterpret_cast<EndQueryProc>(endQuery)(GL_TIME_ELAPSED);
+        queryActive = false;
+
+        PendingFrame& slot = ring[ringIndex];
+        slot.frame = frames;
+        slot.cpuMilliseconds = cpuMilliseconds;
+        slot.inFlight = true;
+        ringIndex = (ringIndex + 1) % queryRingSize;
+    } else {
+        writeCsv(frames, cpuMilliseconds, -1.0);
+    }
+    ++frames;
+}
+
+void FrameProfiler::resolve(PendingFrame& pending, bool wait) {
+    pending.inFlight = false;
+
+    GLint available = 0;
+    if (!wait) {
+        reinterpret_cast<GetQueryObjectivProc>(getQueryObjectiv)(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (wait || available) {
+        uint64_t nanoseconds = 0;
+        reinterpret_cast<GetQueryObjectui64vProc>(getQueryObjectui64v)(pending.query, GL_QUERY_RESULT, &nanoseconds);
+        double gpuMilliseconds = nanoseconds / 1e6;
+        record(gpuSamples, gpuNext, gpuMilliseconds);
+        writeCsv(pending.frame, pending.cpuMilliseconds, gpuMilliseconds);
+    } else {
+        ++gpuDropped;
+        writeCsv(pending.frame, pending.cpuMilliseconds, -1.0);
+    }
+}
+
+// Keeps the most recent maxSamples values
+void FrameProfiler::record(std::vector<double>& samples, size_t& next, double value) {
+    if (samples.size() < maxSamples) {
+        samples.push_back(value);
+    } else {
+        samples[next] = value;
+        next = (next + 1) % maxSamples;
+    }
+}
+
+void FrameProfiler::writeCsv(uint64_t frame, double cpuMilliseconds, double gpuMilliseconds) {
+    if (!csv.is_open()) return;
+    csv << frame << ',' << cpuMilliseconds << ',';
+    if (gpuMilliseconds >= 0.0) csv << gpuMilliseconds;
+    csv << '\n';
+}
+
+void FrameProfiler::report(std::ostream& out) {
+    if (inFrame) endFrame();
+
+    // Drain the ring oldest first so the CSV stays in frame order
+    if (timerQueries) {
+        for (int i = 0; i < queryRingSize; ++i) {
+            PendingFrame& slot = ring[(ringIndex + i) % queryRingSize];
+            if (slot.inFlight) resolve(slot, true);
+        }
+    }
+    if (csv.is_open()) csv.flush();
+
+    out << "[PROFILE] " << frames << " frames" << std::endl;
+    printStatistics(out, "CPU submit", cpuSamples);
+    if (timerQueries) {
+        printStatistics(out, "GPU", gpuSamples);
+        if (gpuDropped > 0) out << "[PROFILE] GPU results not ready in time: " << gpuDropped << std::endl;
+    } else {
+        out << "[PROFILE] GPU timer queries unavailable" << std::endl;
+    }
+}
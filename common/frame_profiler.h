@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-frame CPU and GPU timing for the OpenGL labs.
+//
+// beginFrame()/endFrame() bracket the commands submitted for one frame (call
+// endFrame() before swapping buffers). The CPU time between them is the submit
+// cost; the GPU time comes from a GL_TIME_ELAPSED query. Queries live in a ring
+// and are only read once GL_QUERY_RESULT_AVAILABLE says so, a few frames later,
+// so profiling never stalls the pipeline. Without timer queries (GL < 3.3 and
+// no ARB_timer_query) only CPU times are recorded.
+//
+// The GL header is deliberately not included here so that labs using GLEW can
+// include this file in any order; entry points are fetched through loader,
+// e.g. sf::Context::getFunction.
+class FrameProfiler {
+public:
+    typedef void (*GlFunction)();
+    typedef GlFunction (*GlLoader)(const char* name);
+
+    explicit FrameProfiler(GlLoader loader, size_t maxSamples = 100000);
+    ~FrameProfiler();
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    // Every frame is also written as "frame,cpu_submit_ms,gpu_ms" once its GPU
+    // time is known; gpu_ms is empty when it could not be measured.
+    bool openCsv(const std::string& path);
+
+    void beginFrame();
+    void endFrame();
+
+    bool gpuTimingAvailable() const { return timerQueries; }
+    size_t frameCount() const { return frames; }
+
+    // Waits for outstanding queries and prints p50/p95/p99 of both timings
+    void report(std::ostream& out);
+
+    // Nearest-rank percentile: the smallest sample with at least fraction * n
+    // samples at or below it (index ceil(fraction * n) - 1); 0 when empty
+    static double percentile(std::vector<double> samples, double fraction);
+
+private:
+    struct PendingFrame {
+        unsigned int query = 0;
+        uint64_t frame = 0;
+        double cpuMilliseconds = 0.0;
+        bool inFlight = false;
+    };
+
+    // Number of frames whose GPU results may still be outstanding
+    static const int queryRingSize = 8;
+
+    void resolve(PendingFrame& pending, bool wait);
+    void record(std::vector<double>& samples, size_t& next, double value);
+    void writeCsv(uint64_t frame, double cpuMilliseconds, double gpuMilliseconds);
+
+    // GL entry points, typed in the .cpp
+    GlFunction genQueries = nullptr;
+    GlFunction deleteQueries = nullptr;
+    GlFunction beginQuery = nullptr;
+    GlFunction endQuery = nullptr;
+    GlFunction getQueryObjectiv = nullptr;
+    GlFunction getQueryObjectui64v = nullptr;
+    bool timerQueries = false;
+
+    PendingFrame ring[queryRingSize];
+    int ringIndex = 0;
+    bool inFrame = false;
+    bool queryActive = false;
+    int64_t frameStartNanoseconds = 0;
+    uint64_t frames = 0;
+    uint64_t gpuDropped = 0;
+
+    size_t maxSamples;
+    std::vector<double> cpuSamples;
+    std::vector<double> gpuSamples;
+    size_t cpuNext = 0;
+    size_t gpuNext = 0;
+
+    std::ofstream csv;
+};
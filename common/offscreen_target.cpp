@@ -0,0 +1,385 @@
+#include "offscreen_target.h"
+#include "frame_profiler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#endif
+#ifndef GL_RENDERBUFFER
+#define GL_RENDERBUFFER 0x8D41
+#endif
+#ifndef GL_FRAMEBUFFER_BINDING
+#define GL_FRAMEBUFFER_BINDING 0x8CA6
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_DEPTH_STENCIL_ATTACHMENT
+#define GL_DEPTH_STENCIL_ATTACHMENT 0x821A
+#endif
+#ifndef GL_DEPTH24_STENCIL8
+#define GL_DEPTH24_STENCIL8 0x88F0
+#endif
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+struct OffscreenTarget::GlFunctions {
+    void (APIENTRY *genFramebuffers)(GLsizei, GLuint*);
+    void (APIENTRY *deleteFramebuffers)(GLsizei, const GLuint*);
+    void (APIENTRY *bindFramebuffer)(GLenum, GLuint);
+    GLenum (APIENTRY *checkFramebufferStatus)(GLenum);
+    void (APIENTRY *framebufferRenderbuffer)(GLenum, GLenum, GLenum, GLuint);
+    void (APIENTRY *genRenderbuffers)(GLsizei, GLuint*);
+    void (APIENTRY *deleteRenderbuffers)(GLsizei, const GLuint*);
+    void (APIENTRY *bindRenderbuffer)(GLenum, GLuint);
+    void (APIENTRY *renderbufferStorage)(GLenum, GLenum, GLsizei, GLsizei);
+    void (APIENTRY *genBuffers)(GLsizei, GLuint*);
+    void (APIENTRY *deleteBuffers)(GLsizei, const GLuint*);
+    void (APIENTRY *bindBuffer)(GLenum, GLuint);
+    void (APIENTRY *bufferData)(GLenum, std::ptrdiff_t, const void*, GLenum);
+    void* (APIENTRY *mapBuffer)(GLenum, GLenum);
+    GLboolean (APIENTRY *unmapBuffer)(GLenum);
+
+    bool load(GlLoader loader) {
+        bool ok = true;
+        auto get = [&](auto& function, const char* name) {
+            function = reinterpret_cast<std::remove_reference_t<decltype(function)>>(loader(name));
+            ok = ok && function;
+        };
+        get(genFramebuffers, "glGenFramebuffers");
+        get(deleteFramebuffers, "glDeleteFramebuffers");
+        get(bindFramebuffer, "glBindFramebuffer");
+        get(checkFramebufferStatus, "glCheckFramebufferStatus");
+        get(framebufferRenderbuffer, "glFramebufferRenderbuffer");
+        get(genRenderbuffers, "glGenRenderbuffers");
+        get(deleteRenderbuffers, "glDeleteRenderbuffers");
+        get(bindRenderbuffer, "glBindRenderbuffer");
+        get(renderbufferStorage, "glRenderbufferStorage");
+        get(genBuffers, "glGenBuffers");
+        get(deleteBuffers, "glDeleteBuffers");
+        get(bindBuffer, "glBindBuffer");
+        get(bufferData, "glBufferData");
+        get(mapBuffer, "glMapBuffer");
+        get(unmapBuffer, "glUnmapBuffer");
+        return ok;
+    }
+};
+
+namespace {
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+OffscreenTarget::OffscreenTarget(GlLoader loader, unsigned width, unsigned height, bool depth, int readbackBuffers)
+    : gl(new GlFunctions()), targetWidth(width), targetHeight(height) {
+    if (!loader || !gl->load(loader)) {
+        std::cerr << "ERROR::OFFSCREEN::FRAMEBUFFER_OBJECTS_UNAVAILABLE" << std::endl;
+        return;
+    }
+
+    GLint previous = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+    GLuint object = 0;
+    gl->genFramebuffers(1, &object);
+    framebuffer = object;
+    gl->bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    gl->genRenderbuffers(1, &object);
+    colorBuffer = object;
+    gl->bindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    gl->renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    gl->framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+
+    if (depth) {
+        // Depth with stencil is the combination every driver supports
+        gl->genRenderbuffers(1, &object);
+        depthBuffer = object;
+        gl->bindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        gl->renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        gl->framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    }
+    gl->bindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    complete = gl->checkFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    gl->bindFramebuffer(GL_FRAMEBUFFER, previous);
+    if (!complete) {
+        std::cerr << "ERROR::OFFSCREEN::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        return;
+    }
+
+    slots.resize(std::max(1, readbackBuffers));
+    for (ReadbackSlot& slot : slots) {
+        gl->genBuffers(1, &object);
+        slot.buffer = object;
+        gl->bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        gl->bufferData(GL_PIXEL_PACK_BUFFER, static_cast<std::ptrdiff_t>(width) * height * 4, nullptr, GL_STREAM_READ);
+    }
+    gl->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+OffscreenTarget::~OffscreenTarget() {
+    if (!gl->deleteFramebuffers) return;
+    for (ReadbackSlot& slot : slots) {
+        GLuint buffer = slot.buffer;
+        gl->deleteBuffers(1, &buffer);
+    }
+    GLuint renderbuffers[2] = { colorBuffer, depthBuffer };
+    gl->deleteRenderbuffers(depthBuffer ? 2 : 1, renderbuffers);
+    GLuint object = framebuffer;
+    gl->deleteFramebuffers(1, &object);
+}
+
+void OffscreenTarget::bind() {
+    if (!complete) return;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    gl->bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, targetWidth, targetHeight);
+}
+
+void OffscreenTarget::unbind() {
+    if (!complete) return;
+    gl->bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void OffscreenTarget::readback() {
+    if (!complete) return;
+
+    ReadbackSlot& slot = slots[nextSlot];
+    if (slot.pending) deliver(slot);
+
+    GLint bound = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+    gl->bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    gl->bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, targetWidth, targetHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    gl->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gl->bindFramebuffer(GL_FRAMEBUFFER, bound);
+
+    slot.frame = queued++;
+    slot.pending = true;
+    nextSlot = (nextSlot + 1) % slots.size();
+}
+
+void OffscreenTarget::finish() {
+    // Oldest first, so frames reach the handler in order
+    for (size_t i = 0; i < slots.size(); ++i) {
+        ReadbackSlot& slot = slots[(nextSlot + i) % slots.size()];
+        if (slot.pending) deliver(slot);
+    }
+}
+
+void OffscreenTarget::deliver(ReadbackSlot& slot) {
+    slot.pending = false;
+
+    gl->bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    auto mapStart = std::chrono::steady_clock::now();
+    const unsigned char* pixels = static_cast<const unsigned char*>(gl->mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+    double waited = millisecondsSince(mapStart);
+
+    if (pixels) {
+        mapMilliseconds += waited;
+        mapMillisecondsMax = std::max(mapMillisecondsMax, waited);
+        ++delivered;
+        if (frameHandler) frameHandler(slot.frame, pixels, targetWidth, targetHeight);
+        gl->unmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        std::cerr << "ERROR::OFFSCREEN::MAP_FAILED frame " << slot.frame << std::endl;
+    }
+    gl->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool writePpm(const std::string& path, const unsigned char* rgba, unsigned width, unsigned height) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+    for (unsigned y = height; y-- > 0;) {
+        const unsigned char* source = rgba + static_cast<size_t>(y) * width * 4;
+        for (unsigned x = 0; x < width; ++x) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return static_cast<bool>(file);
+}
+
+bool readPpm(const std::string& path, std::vector<unsigned char>& rgb, unsigned& width, unsigned& height) {
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    unsigned maxValue = 0;
+    if (!(file >> magic >> width >> height >> maxValue) || magic != "P6" || maxValue != 255) return false;
+    file.get(); // single whitespace before the pixel data
+
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+    file.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+    return static_cast<bool>(file);
+}
+
+long long countDifferingPixels(const std::string& referencePath, const unsigned char* rgba, unsigned width,
+                               unsigned height, int tolerance, int* largestDifference) {
+    std::vector<unsigned char> reference;
+    unsigned referenceWidth = 0, referenceHeight = 0;
+    if (!readPpm(referencePath, reference, referenceWidth, referenceHeight) ||
+        referenceWidth != width || referenceHeight != height) {
+        return -1;
+    }
+
+    long long differentPixels = 0;
+    int largest = 0;
+    for (unsigned y = 0; y < height; ++y) {
+        const unsigned char* rendered = rgba + static_cast<size_t>(height - 1 - y) * width * 4;
+        const unsigned char* expected = reference.data() + static_cast<size_t>(y) * width * 3;
+        for (unsigned x = 0; x < width; ++x) {
+            int difference = 0;
+            for (int c = 0; c < 3; ++c) {
+                difference = std::max(difference, std::abs(rendered[x * 4 + c] - expected[x * 3 + c]));
+            }
+            largest = std::max(largest, difference);
+            if (difference > tolerance) ++differentPixels;
+        }
+    }
+    if (largestDifference) *largestDifference = largest;
+    return differentPixels;
+}
+
+const char* const OffscreenOptions::usage =
+    "  --headless             use the EGL backend instead of an SFML window\n"
+    "  --frames N             render N frames into an offscreen target and exit\n"
+    "  --output DIR           where frame_NNNN.ppm and timing.csv go (default \"frames\")\n"
+    "  --size WxH             offscreen image size, 4:3 (default 800x600)\n"
+    "  --reference DIR        compare every frame with the image of the same name\n"
+    "  --tolerance N          largest per-channel difference that still matches\n"
+    "  --max-differing N      pixels beyond the tolerance a frame may still have\n";
+
+bool OffscreenOptions::parseArgument(int argc, char** argv, int& i) {
+    std::string arg = argv[i];
+    if (arg == "--headless") headless = true;
+    else if (arg == "--frames" && i + 1 < argc) frames = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+    else if (arg == "--output" && i + 1 < argc) outputDirectory = argv[++i];
+    else if (arg == "--size" && i + 1 < argc) {
+        unsigned w = 0, h = 0;
+        if (std::sscanf(argv[i + 1], "%ux%u", &w, &h) != 2 || w == 0 || h == 0) return false;
+        width = w;
+        height = h;
+        ++i;
+    }
+    else if (arg == "--reference" && i + 1 < argc) referenceDirectory = argv[++i];
+    else if (arg == "--tolerance" && i + 1 < argc) tolerance = std::max(0, std::atoi(argv[++i]));
+    else if (arg == "--max-differing" && i + 1 < argc) maxDifferingPixels = std::max(0LL, std::atoll(argv[++i]));
+    else return false;
+    return true;
+}
+
+bool renderOffscreen(OffscreenTarget::GlLoader loader, unsigned width, unsigned height,
+                     const OffscreenOptions& options, const std::function<void(unsigned frame)>& renderFrame) {
+    std::error_code error;
+    std::filesystem::create_directories(options.outputDirectory, error);
+    if (error) {
+        std::cerr << "ERROR::OFFSCREEN::OUTPUT_DIRECTORY " << options.outputDirectory << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    OffscreenTarget target(loader, width, height);
+    if (!target.isComplete()) return false;
+
+    FrameProfiler profiler(loader);
+    profiler.openCsv((std::filesystem::path(options.outputDirectory) / "timing.csv").string());
+
+    double writeMilliseconds = 0.0;
+    unsigned compared = 0;
+    unsigned mismatched = 0;
+    unsigned writeFailures = 0;
+    target.setFrameHandler([&](uint64_t frame, const unsigned char* rgba, unsigned w, unsigned h) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%04u.ppm", static_cast<unsigned>(frame));
+        std::string path = (std::filesystem::path(options.outputDirectory) / name).string();
+
+        auto writeStart = std::chrono::steady_clock::now();
+        if (!writePpm(path, rgba, w, h)) {
+            std::cerr << "ERROR::OFFSCREEN::WRITE_FAILED " << path << std::endl;
+            ++writeFailures;
+        }
+        writeMilliseconds += millisecondsSince(writeStart);
+
+        if (options.referenceDirectory.empty()) return;
+
+        ++compared;
+        std::string referencePath = (std::filesystem::path(options.referenceDirectory) / name).string();
+        int largestDifference = 0;
+        long long differentPixels = countDifferingPixels(referencePath, rgba, w, h, options.tolerance, &largestDifference);
+        if (differentPixels < 0) {
+            std::cerr << "ERROR::OFFSCREEN::REFERENCE_MISSING " << referencePath << std::endl;
+            ++mismatched;
+        } else if (!options.matchesReference(differentPixels)) {
+            std::cerr << "ERROR::OFFSCREEN::IMAGE_MISMATCH " << name << ": " << differentPixels
+                      << " pixels differ, largest difference " << largestDifference << std::endl;
+            ++mismatched;
+        }
+    });
+
+    target.bind();
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned frame = 0; frame < options.frames; ++frame) {
+        profiler.beginFrame();
+        renderFrame(frame);
+        profiler.endFrame();
+        target.readback();
+    }
+    target.finish();
+    double totalMilliseconds = millisecondsSince(start);
+    target.unbind();
+
+    profiler.report(std::cout);
+    std::cout << "[OFFSCREEN] " << target.framesDelivered() << " frames of " << width << "x" << height
+              << " in " << totalMilliseconds << " ms (" << (totalMilliseconds > 0.0 ? target.framesDelivered() * 1000.0 / totalMilliseconds : 0.0)
+              << " fps) -> " << options.outputDirectory << std::endl;
+    std::cout << "[OFFSCREEN] readback map wait ms: avg " << target.averageMapMilliseconds()
+              << "  max " << target.maxMapMilliseconds()
+              << "; image writing " << writeMilliseconds << " ms total" << std::endl;
+    if (!options.referenceDirectory.empty()) {
+        std::cout << "[OFFSCREEN] " << compared - mismatched << " of " << compared << " frames match "
+                  << options.referenceDirectory << " (tolerance " << options.tolerance << ", up to "
+                  << options.maxDifferingPixels << " differing pixels)" << std::endl;
+    }
+    return mismatched == 0 && writeFailures == 0 && target.framesDelivered() == options.frames;
+}
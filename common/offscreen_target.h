@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Framebuffer object with RGBA8 color and a 24-bit depth/stencil
+// renderbuffer, plus a ring of pixel buffer objects for asynchronous readback.
+//
+// readback() only queues a glReadPixels into the next pixel buffer and
+// returns. A buffer is mapped when the ring comes back around to it, by which
+// time the copy has normally finished, so reading frames back doesn't stall
+// the CPU on the GPU every frame. Finished frames go to the frame handler, in
+// order; finish() delivers the ones still in flight.
+//
+// Like FrameProfiler, this header doesn't include the GL header; entry points
+// come from loader.
+class OffscreenTarget {
+public:
+    typedef void (*GlFunction)();
+    typedef GlFunction (*GlLoader)(const char* name);
+
+    // Pixels are RGBA, bottom row first, as glReadPixels returns them
+    typedef std::function<void(uint64_t frame, const unsigned char* rgba, unsigned width, unsigned height)> FrameHandler;
+
+    OffscreenTarget(GlLoader loader, unsigned width, unsigned height, bool depth = true, int readbackBuffers = 3);
+    ~OffscreenTarget();
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+    // False when framebuffer or pixel buffer objects are unavailable
+    bool isComplete() const { return complete; }
+    unsigned width() const { return targetWidth; }
+    unsigned height() const { return targetHeight; }
+
+    // Directs drawing into the target and sets the viewport to cover it;
+    // unbind() restores the framebuffer that was bound before
+    void bind();
+    void unbind();
+
+    void setFrameHandler(FrameHandler handler) { frameHandler = std::move(handler); }
+    void readback();
+    void finish();
+
+    uint64_t framesDelivered() const { return delivered; }
+    // Time spent in glMapBuffer, i.e. waiting for a copy to finish
+    double averageMapMilliseconds() const { return delivered ? mapMilliseconds / delivered : 0.0; }
+    double maxMapMilliseconds() const { return mapMillisecondsMax; }
+
+private:
+    struct GlFunctions;
+    struct ReadbackSlot {
+        unsigned int buffer = 0;
+        uint64_t frame = 0;
+        bool pending = false;
+    };
+
+    void deliver(ReadbackSlot& slot);
+
+    std::unique_ptr<GlFunctions> gl;
+    bool complete = false;
+    unsigned targetWidth;
+    unsigned targetHeight;
+    unsigned int framebuffer = 0;
+    unsigned int colorBuffer = 0;
+    unsigned int depthBuffer = 0;
+    int previousFramebuffer = 0;
+    int previousViewport[4] = { 0, 0, 0, 0 };
+
+    std::vector<ReadbackSlot> slots;
+    size_t nextSlot = 0;
+    uint64_t queued = 0;
+    uint64_t delivered = 0;
+    double mapMilliseconds = 0.0;
+    double mapMillisecondsMax = 0.0;
+    FrameHandler frameHandler;
+};
+
+// Binary PPM (P6); rgba is bottom row first and is flipped while writing
+bool writePpm(const std::string& path, const unsigned char* rgba, unsigned width, unsigned height);
+// Reads a P6 file into RGB bytes, top row first
+bool readPpm(const std::string& path, std::vector<unsigned char>& rgb, unsigned& width, unsigned& height);
+// Number of pixels where some channel of rgba (bottom row first) differs from
+// the reference PPM by more than tolerance, or -1 if the reference can't be
+// read or has another size
+long long countDifferingPixels(const std::string& referencePath, const unsigned char* rgba, unsigned width,
+                               unsigned height, int tolerance, int* largestDifference = nullptr);
+
+// Command line switches shared by the labs for rendering without a window:
+//   --headless             use the EGL backend instead of an SFML window
+//   --frames N             render N frames into an offscreen target and exit
+//   --output DIR           where frame_NNNN.ppm and timing.csv go (default "frames")
+//   --size WxH             offscreen image size (default 800x600); the labs'
+//                          projections assume 4:3
+//   --reference DIR        compare every frame with the image of the same name
+//   --tolerance N          largest per-channel difference that still matches
+//   --max-differing N      pixels beyond the tolerance a frame may still have
+struct OffscreenOptions {
+    bool headless = false;
+    unsigned frames = 0;
+    std::string outputDirectory = "frames";
+    unsigned width = 800;
+    unsigned height = 600;
+    std::string referenceDirectory;
+    int tolerance = 2;
+    long long maxDifferingPixels = 0;
+
+    // Whether countDifferingPixels' result is a match under these options
+    bool matchesReference(long long differentPixels) const {
+        return differentPixels >= 0 && differentPixels <= maxDifferingPixels;
+    }
+
+    // The switches above as usage lines, appended to every lab's usage text
+    static const char* const usage;
+
+    // Consumes argv[i] (and its value, advancing i) if it is one of the
+    // switches above
+    bool parseArgument(int argc, char** argv, int& i);
+};
+
+// Renders options.frames frames through renderFrame(frameIndex) into an
+// OffscreenTarget of the given size, writes the images and per-frame timings
+// to options.outputDirectory and prints a summary. Returns false if the target
+// can't be created, a frame can't be written or doesn't match its reference.
+bool renderOffscreen(OffscreenTarget::GlLoader loader, unsigned width, unsigned height,
+                     const OffscreenOptions& options, const std::function<void(unsigned frame)>& renderFrame);
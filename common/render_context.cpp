@@ -0,0 +1,154 @@
+#include "render_context.h"
+#include "offscreen_target.h"
+
+#ifdef LAB_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+
+#include <cstring>
+#include <iostream>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+namespace {
+
+class WindowedContext : public RenderContext {
+public:
+    WindowedContext(unsigned width, unsigned height, const std::string& title, sf::Uint32 style,
+                    const sf::ContextSettings& settings)
+        : sfmlWindow(sf::VideoMode(width, height), title, style, settings) {}
+
+    Backend backend() const override { return Backend::Windowed; }
+    GlLoader loader() const override { return sf::Context::getFunction; }
+    void present() override { sfmlWindow.display(); }
+    sf::Window* window() override { return &sfmlWindow; }
+
+private:
+    sf::Window sfmlWindow;
+};
+
+#ifdef LAB_HAVE_EGL
+
+RenderContext::GlFunction eglLoader(const char* name) {
+    return reinterpret_cast<RenderContext::GlFunction>(eglGetProcAddress(name));
+}
+
+bool hasExtension(const char* extensions, const char* name) {
+    if (!extensions) return false;
+    size_t length = std::strlen(name);
+    for (const char* found = std::strstr(extensions, name); found; found = std::strstr(found + length, name)) {
+        bool startsWord = found == extensions || found[-1] == ' ';
+        bool endsWord = found[length] == ' ' || found[length] == '\0';
+        if (startsWord && endsWord) return true;
+    }
+    return false;
+}
+
+class HeadlessContext : public RenderContext {
+public:
+    ~HeadlessContext() override {
+        framebuffer.reset();
+        if (context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (display != EGL_NO_DISPLAY) eglTerminate(display);
+    }
+
+    bool create(unsigned width, unsigned height, const sf::ContextSettings& settings) {
+        // Prefer the surfaceless platform: it never touches X or a DRM master
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            std::cerr << "ERROR::RENDER_CONTEXT::EGL_DISPLAY" << std::endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+            std::cerr << "ERROR::RENDER_CONTEXT::EGL_SURFACELESS_UNSUPPORTED" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cerr << "ERROR::RENDER_CONTEXT::EGL_NO_DESKTOP_GL" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            std::cerr << "ERROR::RENDER_CONTEXT::EGL_CONFIG" << std::endl;
+            return false;
+        }
+
+        // Like SFML, only ask for a specific version when the lab does;
+        // otherwise the driver's newest compatibility context is fine
+        EGLint contextAttributes[7];
+        int count = 0;
+        if (settings.majorVersion >= 3) {
+            contextAttributes[count++] = EGL_CONTEXT_MAJOR_VERSION;
+            contextAttributes[count++] = static_cast<EGLint>(settings.majorVersion);
+            contextAttributes[count++] = EGL_CONTEXT_MINOR_VERSION;
+            contextAttributes[count++] = static_cast<EGLint>(settings.minorVersion);
+            contextAttributes[count++] = EGL_CONTEXT_OPENGL_PROFILE_MASK;
+            contextAttributes[count++] = (settings.attributeFlags & sf::ContextSettings::Core)
+                ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT;
+        }
+        contextAttributes[count] = EGL_NONE;
+
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            std::cerr << "ERROR::RENDER_CONTEXT::EGL_CONTEXT 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+
+        framebuffer.reset(new OffscreenTarget(eglLoader, width, height, settings.depthBits > 0));
+        if (!framebuffer->isComplete()) return false;
+        framebuffer->bind();
+        return true;
+    }
+
+    Backend backend() const override { return Backend::Headless; }
+    GlLoader loader() const override { return eglLoader; }
+    void present() override { glFlush(); }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    // Stands in for the default framebuffer
+    std::unique_ptr<OffscreenTarget> framebuffer;
+};
+
+#endif // LAB_HAVE_EGL
+
+} // namespace
+
+std::unique_ptr<RenderContext> RenderContext::create(Backend backend, unsigned width, unsigned height,
+                                                     const std::string& title, sf::Uint32 style,
+                                                     const sf::ContextSettings& settings) {
+    if (backend == Backend::Windowed) {
+        return std::unique_ptr<RenderContext>(new WindowedContext(width, height, title, style, settings));
+    }
+
+#ifdef LAB_HAVE_EGL
+    std::unique_ptr<HeadlessContext> context(new HeadlessContext());
+    if (!context->create(width, height, settings)) return nullptr;
+    return std::unique_ptr<RenderContext>(context.release());
+#else
+    std::cerr << "ERROR::RENDER_CONTEXT::HEADLESS_UNAVAILABLE built without EGL" << std::endl;
+    return nullptr;
+#endif
+}
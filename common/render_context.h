@@ -0,0 +1,43 @@
+#pragma once
+
+#include <SFML/Window.hpp>
+
+#include <memory>
+#include <string>
+
+// The OpenGL context a lab renders with.
+//
+// The windowed backend is the usual sf::Window. The headless backend is an
+// EGL context without any surface (EGL_MESA_platform_surfaceless where
+// available, otherwise the default EGL display with
+// EGL_KHR_surfaceless_context), so it needs no X server or GPU display. It
+// has no default framebuffer either; instead it binds a built-in framebuffer
+// object of the requested size, so code written for a window draws into that
+// unchanged as long as it never binds framebuffer 0 itself.
+//
+// The headless backend is only compiled in when CMake finds EGL
+// (LAB_HAVE_EGL); without it create() reports an error and returns null.
+class RenderContext {
+public:
+    typedef void (*GlFunction)();
+    typedef GlFunction (*GlLoader)(const char* name);
+
+    enum class Backend { Windowed, Headless };
+
+    // settings.depthBits, majorVersion/minorVersion and the Core attribute
+    // flag are honoured by both backends; style and title only by the window.
+    // Errors are printed to std::cerr.
+    static std::unique_ptr<RenderContext> create(Backend backend, unsigned width, unsigned height,
+                                                 const std::string& title, sf::Uint32 style,
+                                                 const sf::ContextSettings& settings);
+
+    virtual ~RenderContext() = default;
+
+    virtual Backend backend() const = 0;
+    // Resolves GL entry points for this context, e.g. for FrameProfiler
+    virtual GlLoader loader() const = 0;
+    // window.display() for the windowed backend, glFlush() when headless
+    virtual void present() = 0;
+    // The SFML window, or nullptr for the headless backend
+    virtual sf::Window* window() { return nullptr; }
+};
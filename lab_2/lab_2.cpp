@@ -1,14 +1,22 @@
 #include <SFML/Window.hpp>
 #include <SFML/OpenGL.hpp>
 #include <GL/glu.h>
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "frame_profiler.h"
+#include "offscreen_target.h"
+#include "render_context.h"
 
 // Parameters for sphere and camera
 float sphereRadius = 1.0f;
 float cameraDistance = 5.0f;
 float cameraAngle = 0.0f;
 
-// Function to draw a sphere
+// Immediate-mode path, kept for comparison with the cached meshes below
 void drawSphere(float radius, int slices, int stacks) {
     for (int i = 0; i < slices; ++i) {
         float theta1 = i * M_PI * 2.0f / slices;
@@ -33,15 +41,321 @@ void drawSphere(float radius, int slices, int stacks) {
     }
 }
 
-int main() {
-    // Create an SFML window
-    sf::Window window(sf::VideoMode(800, 600), "3D Sphere with SFML and OpenGL", sf::Style::Default, sf::ContextSettings(24));
-    window.setVerticalSyncEnabled(true);
+// ---------------------------------------------------------------------------
+// Cached sphere meshes
+// ---------------------------------------------------------------------------
+
+// Buffer objects are GL 1.5; the GL 1.1 headers some platforms ship don't
+// declare them, so the entry points are fetched at runtime
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+typedef void (APIENTRY *GenBuffersProc)(GLsizei, GLuint*);
+typedef void (APIENTRY *DeleteBuffersProc)(GLsizei, const GLuint*);
+typedef void (APIENTRY *BindBufferProc)(GLenum, GLuint);
+typedef void (APIENTRY *BufferDataProc)(GLenum, std::ptrdiff_t, const void*, GLenum);
+
+// Segment counts (slices == stacks) of the detail levels, coarsest first
+const int sphereLodSegments[] = { 8, 12, 16, 24, 32, 48, 64, 96 };
+const int sphereLodCount = sizeof(sphereLodSegments) / sizeof(sphereLodSegments[0]);
+
+// Largest allowed gap between the true silhouette and the polygon, in pixels
+const float sphereLodMaxErrorPixels = 0.5f;
+
+// Unit spheres at every detail level, generated once and drawn with
+// glDrawElements. Positions double as normals; the radius is applied with
+// glScalef and GL_NORMALIZE. Uses VBOs when the driver has them, otherwise
+// plain client-side vertex arrays.
+class SphereMeshCache {
+public:
+    explicit SphereMeshCache(RenderContext::GlLoader loader) {
+        genBuffers = reinterpret_cast<GenBuffersProc>(loader("glGenBuffers"));
+        deleteBuffers = reinterpret_cast<DeleteBuffersProc>(loader("glDeleteBuffers"));
+        bindBuffer = reinterpret_cast<BindBufferProc>(loader("glBindBuffer"));
+        bufferData = reinterpret_cast<BufferDataProc>(loader("glBufferData"));
+        useBuffers = genBuffers && deleteBuffers && bindBuffer && bufferData;
+
+        for (int i = 0; i < sphereLodCount; ++i) build(levels[i], sphereLodSegments[i]);
+    }
+
+    ~SphereMeshCache() {
+        if (!useBuffers) return;
+        for (Level& level : levels) {
+            GLuint buffers[2] = { level.vbo, level.ebo };
+            deleteBuffers(2, buffers);
+        }
+    }
+
+    SphereMeshCache(const SphereMeshCache&) = delete;
+    SphereMeshCache& operator=(const SphereMeshCache&) = delete;
+
+    bool usesBuffers() const { return useBuffers; }
+
+    // Coarsest level whose silhouette stays within sphereLodMaxErrorPixels of
+    // a true sphere of this radius seen from distance, on a viewport of the
+    // given height and vertical field of view. With N segments a chord sits
+    // r * (1 - cos(pi / N)) inside the circle of projected radius r.
+    static int selectLod(float radius, float distance, float fovDegrees, float viewportHeight) {
+        if (distance <= radius) return sphereLodCount - 1;
+
+        // Tangent of the angular radius, projected onto the image plane
+        float tangent = radius / std::sqrt(distance * distance - radius * radius);
+        float pixelsPerUnit = viewportHeight * 0.5f / std::tan(fovDegrees * 0.5f * static_cast<float>(M_PI) / 180.0f);
+        float projectedRadius = tangent * pixelsPerUnit;
+
+        for (int i = 0; i < sphereLodCount; ++i) {
+            float error = projectedRadius * (1.0f - std::cos(static_cast<float>(M_PI) / sphereLodSegments[i]));
+            if (error <= sphereLodMaxErrorPixels) return i;
+        }
+        return sphereLodCount - 1;
+    }
+
+    void draw(int lod, float radius) const {
+        const Level& level = levels[std::max(0, std::min(lod, sphereLodCount - 1))];
+
+        glPushMatrix();
+        glScalef(radius, radius, radius);
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        if (useBuffers) {
+            bindBuffer(GL_ARRAY_BUFFER, level.vbo);
+            bindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.ebo);
+            glVertexPointer(3, GL_FLOAT, 3 * sizeof(float), nullptr);
+            glNormalPointer(GL_FLOAT, 3 * sizeof(float), nullptr);
+            glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_SHORT, nullptr);
+            bindBuffer(GL_ARRAY_BUFFER, 0);
+            bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        } else {
+            glVertexPointer(3, GL_FLOAT, 3 * sizeof(float), level.vertices.data());
+            glNormalPointer(GL_FLOAT, 3 * sizeof(float), level.vertices.data());
+            glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_SHORT, level.indices.data());
+        }
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
+        glPopMatrix();
+    }
+
+private:
+    struct Level {
+        GLuint vbo = 0;
+        GLuint ebo = 0;
+        GLsizei indexCount = 0;
+        // Only kept when drawing from client memory
+        std::vector<GLfloat> vertices;
+        std::vector<GLushort> indices;
+    };
+
+    // Same parametrisation as drawSphere: theta around the Y axis, phi from
+    // the north pole. The seam column is duplicated so every row is a plain
+    // grid of (segments + 1) vertices.
+    void build(Level& level, int segments) {
+        // Trig tables: segments + 1 angles per direction instead of a sin/cos
+        // pair per vertex
+        std::vector<float> sinTheta(segments + 1), cosTheta(segments + 1);
+        std::vector<float> sinPhi(segments + 1), cosPhi(segments + 1);
+        for (int i = 0; i <= segments; ++i) {
+            double theta = i * M_PI * 2.0 / segments;
+            double phi = i * M_PI / segments;
+            sinTheta[i] = static_cast<float>(std::sin(theta));
+            cosTheta[i] = static_cast<float>(std::cos(theta));
+            sinPhi[i] = static_cast<float>(std::sin(phi));
+            cosPhi[i] = static_cast<float>(std::cos(phi));
+        }
+
+        const int row = segments + 1;
+        std::vector<GLfloat> vertices;
+        vertices.reserve(row * row * 3);
+        for (int j = 0; j <= segments; ++j) {
+            for (int i = 0; i <= segments; ++i) {
+                vertices.push_back(sinPhi[j] * cosTheta[i]);
+                vertices.push_back(cosPhi[j]);
+                vertices.push_back(sinPhi[j] * sinTheta[i]);
+            }
+        }
+
+        // Counter-clockwise seen from outside
+        std::vector<GLushort> indices;
+        indices.reserve(segments * segments * 6);
+        for (int j = 0; j < segments; ++j) {
+            for (int i = 0; i < segments; ++i) {
+                GLushort a = static_cast<GLushort>(j * row + i);
+                GLushort b = static_cast<GLushort>(a + row);
+                GLushort c = static_cast<GLushort>(a + 1);
+                GLushort d = static_cast<GLushort>(b + 1);
+                indices.insert(indices.end(), { a, c, b, c, d, b });
+            }
+        }
+        level.indexCount = static_cast<GLsizei>(indices.size());
+
+        if (useBuffers) {
+            GLuint buffers[2];
+            genBuffers(2, buffers);
+            level.vbo = buffers[0];
+            level.ebo = buffers[1];
+            bindBuffer(GL_ARRAY_BUFFER, level.vbo);
+            bufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+            bindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.ebo);
+            bufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+            bindBuffer(GL_ARRAY_BUFFER, 0);
+            bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        } else {
+            level.vertices.swap(vertices);
+            level.indices.swap(indices);
+        }
+    }
+
+    GenBuffersProc genBuffers = nullptr;
+    DeleteBuffersProc deleteBuffers = nullptr;
+    BindBufferProc bindBuffer = nullptr;
+    BufferDataProc bufferData = nullptr;
+    bool useBuffers = false;
+
+    Level levels[sphereLodCount];
+};
+
+// Projection, camera, light and sphere for one frame. A negative lod picks the
+// level from the current radius and camera distance.
+void renderScene(const SphereMeshCache& spheres, bool immediate, int lod = -1) {
+    // Clear the window
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(60.0, 800.0 / 600.0, 1.0, 100.0);
+
+    // Set camera position
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    gluLookAt(
+        cameraDistance * sin(cameraAngle * M_PI / 180.0),
+        0.0,
+        cameraDistance * cos(cameraAngle * M_PI / 180.0),
+        0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0);
+
+    // Add lighting
+    GLfloat lightPos[] = { 2.0f, 2.0f, 2.0f, 1.0f };
+    glLightfv(GL_LIGHT0, GL_POSITION, lightPos);
+
+    // Draw the sphere
+    glColor3f(0.5f, 0.7f, 0.9f);
+    if (immediate) {
+        drawSphere(sphereRadius, 30, 30);
+    } else {
+        if (lod < 0) lod = SphereMeshCache::selectLod(sphereRadius, cameraDistance, 60.0f, 600.0f);
+        spheres.draw(lod, sphereRadius);
+    }
+}
+
+// Renders the same frames through both paths and prints their timings. Each
+// frame ends with glFinish inside the profiled range: drivers defer the
+// buffered immediate-mode vertices until the next flush, which would
+// otherwise fall outside the measurement.
+void runSphereBenchmark(RenderContext& context, const SphereMeshCache& spheres) {
+    const int framesPerRun = 300;
+    const float distances[] = { 2.0f, 5.0f, 20.0f };
+
+    if (context.window()) context.window()->setVerticalSyncEnabled(false);
+    std::cout << "[BENCH] cached meshes in " << (spheres.usesBuffers() ? "VBOs" : "client arrays") << std::endl;
+
+    for (float distance : distances) {
+        cameraDistance = distance;
+        // Immediate 30x30, the cached 32x32 level (about the same detail) and
+        // the level the LOD selection picks for this distance
+        int lods[3] = { -1, 4, SphereMeshCache::selectLod(sphereRadius, cameraDistance, 60.0f, 600.0f) };
+
+        for (int lod : lods) {
+            FrameProfiler profiler(context.loader());
+            for (int frame = 0; frame < framesPerRun; ++frame) {
+                cameraAngle = frame * 360.0f / framesPerRun;
+                profiler.beginFrame();
+                renderScene(spheres, lod < 0, lod);
+                glFinish();
+                profiler.endFrame();
+                context.present();
+            }
+
+            std::cout << "[BENCH] distance " << distance << ", "
+                      << (lod < 0 ? std::string("immediate 30x30") : "cached " + std::to_string(sphereLodSegments[lod]) + "x" + std::to_string(sphereLodSegments[lod])) << std::endl;
+            profiler.report(std::cout);
+        }
+    }
+}
+
+const char* const usage =
+    "Usage:\n"
+    "  lab_2                       spheres in a window, Up/Down change the radius\n"
+    "  lab_2 --immediate           draw with immediate mode instead of the cached meshes\n"
+    "  lab_2 --bench-sphere        immediate vs cached sphere meshes at several distances\n"
+    "  lab_2 --profile-csv FILE    also dump per-frame CPU/GPU times as CSV\n"
+    "Offscreen rendering:\n";
+
+int main(int argc, char** argv) {
+    // Frame timing; --profile-csv FILE also dumps every frame
+    std::string profileCsvPath;
+    bool immediate = false;
+    bool benchmark = false;
+    OffscreenOptions offscreen;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (offscreen.parseArgument(argc, argv, i)) continue;
+        if (arg == "--profile-csv" && i + 1 < argc) profileCsvPath = argv[++i];
+        else if (arg == "--immediate") immediate = true;
+        else if (arg == "--bench-sphere") benchmark = true;
+        else {
+            std::cerr << "ERROR::LAB_2::UNKNOWN_ARGUMENT " << arg << std::endl << usage << OffscreenOptions::usage;
+            return 1;
+        }
+    }
+    if (offscreen.headless && offscreen.frames == 0 && !benchmark) {
+        std::cerr << "ERROR::LAB_2::HEADLESS_NEEDS_FRAMES use --frames N or --bench-sphere" << std::endl;
+        return 1;
+    }
+
+    // Create an SFML window, or an EGL context with --headless
+    auto context = RenderContext::create(
+        offscreen.headless ? RenderContext::Backend::Headless : RenderContext::Backend::Windowed,
+        800, 600, "3D Sphere with SFML and OpenGL", sf::Style::Default, sf::ContextSettings(24));
+    if (!context) return 1;
 
     // Enable OpenGL features
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_LIGHTING);
     glEnable(GL_LIGHT0);
+    // The cached spheres are unit meshes scaled by the radius
+    glEnable(GL_NORMALIZE);
+
+    SphereMeshCache spheres(context->loader());
+    if (benchmark) {
+        runSphereBenchmark(*context, spheres);
+        return 0;
+    }
+
+    // Offscreen frames orbit the camera 2 degrees per frame
+    if (offscreen.frames > 0) {
+        bool matches = renderOffscreen(context->loader(), offscreen.width, offscreen.height, offscreen, [&](unsigned frame) {
+            cameraAngle = frame * 2.0f;
+            renderScene(spheres, immediate);
+        });
+        return matches ? 0 : 1;
+    }
+
+    sf::Window& window = *context->window();
+    window.setVerticalSyncEnabled(true);
+
+    FrameProfiler profiler(context->loader());
+    if (!profileCsvPath.empty()) profiler.openCsv(profileCsvPath);
 
     // Main loop
     while (window.isOpen()) {
@@ -67,36 +381,21 @@ int main() {
                     cameraAngle -= 5.0f;
                 if (event.key.code == sf::Keyboard::Right)
                     cameraAngle += 5.0f;
+
+                // Switch between the immediate-mode and cached sphere
+                if (event.key.code == sf::Keyboard::M)
+                    immediate = !immediate;
             }
         }
 
-        // Clear the window
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        gluPerspective(60.0, 800.0 / 600.0, 1.0, 100.0);
-
-        // Set camera position
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        gluLookAt(
-            cameraDistance * sin(cameraAngle * M_PI / 180.0),
-            0.0,
-            cameraDistance * cos(cameraAngle * M_PI / 180.0),
-            0.0, 0.0, 0.0,
-            0.0, 1.0, 0.0);
-
-        // Add lighting
-        GLfloat lightPos[] = { 2.0f, 2.0f, 2.0f, 1.0f };
-        glLightfv(GL_LIGHT0, GL_POSITION, lightPos);
-
-        // Draw the sphere
-        glColor3f(0.5f, 0.7f, 0.9f);
-        drawSphere(sphereRadius, 30, 30);
+        profiler.beginFrame();
+        renderScene(spheres, immediate);
+        profiler.endFrame();
 
         // Display the frame
         window.display();
     }
 
+    profiler.report(std::cout);
     return 0;
 }
@@ -1,12 +1,62 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#include <SFML/System.hpp>
 #include <SFML/Window.hpp>
 #include <SFML/OpenGL.hpp>
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "frame_profiler.h"
+#include "offscreen_target.h"
+#include "render_context.h"
 
-float angleX = 0.0f, angleY = 0.0f, angleZ = 0.0f; // Углы вращения
-float rotationSpeed = 0.2f; // Скорость вращения
+// Углы вращения в градусах
+struct Rotation {
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+};
+
+float rotationSpeed = 90.0f; // Скорость вращения, градусов в секунду
+
+// Шаг симуляции не зависит от частоты кадров: состояние обновляется ровно
+// 120 раз в секунду, а кадр рисуется с интерполяцией между двумя шагами
+const double simulationStep = 1.0 / 120.0;
+// Дольше этого кадр не догоняет симуляцию (например, после перетаскивания окна)
+const double maxFrameTime = 0.25;
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+// Процессорное время процесса (пользовательское + системное) в секундах,
+// или -1, если его не узнать. std::clock() не годится: в MSVC он считает
+// реальное время, и загрузка всегда выходила бы около 100%
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return -1.0;
+    auto seconds = [](const FILETIME& time) {
+        return ((static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1.0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
 
 void initOpenGL() {
     glEnable(GL_DEPTH_TEST); // Включаем тест глубины для правильной отрисовки
@@ -17,81 +67,275 @@ void initOpenGL() {
     glMatrixMode(GL_MODELVIEW); // Переходим к моделированию
 }
 
-void drawCube() {
-    glBegin(GL_QUADS);
+// Буферы вершин появились в GL 1.5, в заголовках GL 1.1 их может не быть,
+// поэтому функции загружаются во время выполнения
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+typedef void (APIENTRY *GenBuffersProc)(GLsizei, GLuint*);
+typedef void (APIENTRY *DeleteBuffersProc)(GLsizei, const GLuint*);
+typedef void (APIENTRY *BindBufferProc)(GLenum, GLuint);
+typedef void (APIENTRY *BufferDataProc)(GLenum, std::ptrdiff_t, const void*, GLenum);
 
+// Вершина куба: позиция и цвет грани
+struct CubeVertex {
+    GLfloat position[3];
+    GLfloat color[3];
+};
+
+const CubeVertex cubeVertices[] = {
     // Передняя грань
-    glColor3f(1.0f, 0.0f, 0.0f);
-    glVertex3f(-0.5f, -0.5f,  0.5f);
-    glVertex3f( 0.5f, -0.5f,  0.5f);
-    glVertex3f( 0.5f,  0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f,  0.5f);
+    { {-0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.0f} },
+    { { 0.5f, -0.5f,  0.5f}, {1.0f, 0.0f, 0.0f} },
+    { { 0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.0f} },
+    { {-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 0.0f} },
 
     // Задняя грань
-    glColor3f(0.0f, 1.0f, 0.0f);
-    glVertex3f(-0.5f, -0.5f, -0.5f);
-    glVertex3f(-0.5f,  0.5f, -0.5f);
-    glVertex3f( 0.5f,  0.5f, -0.5f);
-    glVertex3f( 0.5f, -0.5f, -0.5f);
+    { {-0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f} },
+    { {-0.5f,  0.5f, -0.5f}, {0.0f, 1.0f, 0.0f} },
+    { { 0.5f,  0.5f, -0.5f}, {0.0f, 1.0f, 0.0f} },
+    { { 0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f} },
 
     // Левая грань
-    glColor3f(0.0f, 0.0f, 1.0f);
-    glVertex3f(-0.5f, -0.5f, -0.5f);
-    glVertex3f(-0.5f, -0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f, -0.5f);
+    { {-0.5f, -0.5f, -0.5f}, {0.0f, 0.0f, 1.0f} },
+    { {-0.5f, -0.5f,  0.5f}, {0.0f, 0.0f, 1.0f} },
+    { {-0.5f,  0.5f,  0.5f}, {0.0f, 0.0f, 1.0f} },
+    { {-0.5f,  0.5f, -0.5f}, {0.0f, 0.0f, 1.0f} },
 
     // Правая грань
-    glColor3f(1.0f, 1.0f, 0.0f);
-    glVertex3f(0.5f, -0.5f, -0.5f);
-    glVertex3f(0.5f,  0.5f, -0.5f);
-    glVertex3f(0.5f,  0.5f,  0.5f);
-    glVertex3f(0.5f, -0.5f,  0.5f);
+    { {0.5f, -0.5f, -0.5f}, {1.0f, 1.0f, 0.0f} },
+    { {0.5f,  0.5f, -0.5f}, {1.0f, 1.0f, 0.0f} },
+    { {0.5f,  0.5f,  0.5f}, {1.0f, 1.0f, 0.0f} },
+    { {0.5f, -0.5f,  0.5f}, {1.0f, 1.0f, 0.0f} },
 
     // Верхняя грань
-    glColor3f(1.0f, 0.0f, 1.0f);
-    glVertex3f(-0.5f,  0.5f, -0.5f);
-    glVertex3f( 0.5f,  0.5f, -0.5f);
-    glVertex3f( 0.5f,  0.5f,  0.5f);
-    glVertex3f(-0.5f,  0.5f,  0.5f);
+    { {-0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 1.0f} },
+    { { 0.5f,  0.5f, -0.5f}, {1.0f, 0.0f, 1.0f} },
+    { { 0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 1.0f} },
+    { {-0.5f,  0.5f,  0.5f}, {1.0f, 0.0f, 1.0f} },
 
     // Нижняя грань
-    glColor3f(0.0f, 1.0f, 1.0f);
-    glVertex3f(-0.5f, -0.5f, -0.5f);
-    glVertex3f(-0.5f, -0.5f,  0.5f);
-    glVertex3f( 0.5f, -0.5f,  0.5f);
-    glVertex3f( 0.5f, -0.5f, -0.5f);
+    { {-0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 1.0f} },
+    { {-0.5f, -0.5f,  0.5f}, {0.0f, 1.0f, 1.0f} },
+    { { 0.5f, -0.5f,  0.5f}, {0.0f, 1.0f, 1.0f} },
+    { { 0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 1.0f} },
+};
 
-    glEnd();
-}
+// Куб загружается в буфер один раз и рисуется одним glDrawArrays. Если
+// буферов нет, те же данные берутся из памяти клиента.
+class CubeMesh {
+public:
+    explicit CubeMesh(RenderContext::GlLoader loader) {
+        genBuffers = reinterpret_cast<GenBuffersProc>(loader("glGenBuffers"));
+        deleteBuffers = reinterpret_cast<DeleteBuffersProc>(loader("glDeleteBuffers"));
+        bindBuffer = reinterpret_cast<BindBufferProc>(loader("glBindBuffer"));
+        BufferDataProc bufferData = reinterpret_cast<BufferDataProc>(loader("glBufferData"));
+
+        if (genBuffers && deleteBuffers && bindBuffer && bufferData) {
+            genBuffers(1, &vbo);
+            bindBuffer(GL_ARRAY_BUFFER, vbo);
+            bufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+            bindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    ~CubeMesh() {
+        if (vbo) deleteBuffers(1, &vbo);
+    }
+
+    CubeMesh(const CubeMesh&) = delete;
+    CubeMesh& operator=(const CubeMesh&) = delete;
+
+    void draw() const {
+        // Смещения внутри буфера или указатели в массив, если буфера нет
+        const char* base = vbo ? nullptr : reinterpret_cast<const char*>(cubeVertices);
+        if (vbo) bindBuffer(GL_ARRAY_BUFFER, vbo);
+
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(CubeVertex), base + offsetof(CubeVertex, position));
+        glColorPointer(3, GL_FLOAT, sizeof(CubeVertex), base + offsetof(CubeVertex, color));
+        glDrawArrays(GL_QUADS, 0, sizeof(cubeVertices) / sizeof(cubeVertices[0]));
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+
+        if (vbo) bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    GenBuffersProc genBuffers = nullptr;
+    DeleteBuffersProc deleteBuffers = nullptr;
+    BindBufferProc bindBuffer = nullptr;
+    GLuint vbo = 0;
+};
+
+// Один шаг симуляции длиной dt секунд
+void updateRotation(Rotation& rotation, float dt) {
+    float step = rotationSpeed * dt;
 
-void updateRotation() {
     // Обрабатываем ввод с клавиатуры для изменения углов вращения
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left)) {
-        angleY -= rotationSpeed;
+        rotation.y -= step;
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) {
-        angleY += rotationSpeed;
+        rotation.y += step;
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) {
-        angleX -= rotationSpeed;
+        rotation.x -= step;
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) {
-        angleX += rotationSpeed;
+        rotation.x += step;
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
-        angleZ -= rotationSpeed;
+        rotation.z -= step;
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
-        angleZ += rotationSpeed;
+        rotation.z += step;
     }
 }
 
-int main() {
-    sf::Window window(sf::VideoMode(800, 600), "SFML/OpenGL Cube Rotation", sf::Style::Default, sf::ContextSettings(24, 8, 4, 3, 3));
+Rotation interpolate(const Rotation& previous, const Rotation& current, float alpha) {
+    Rotation result;
+    result.x = previous.x + (current.x - previous.x) * alpha;
+    result.y = previous.y + (current.y - previous.y) * alpha;
+    result.z = previous.z + (current.z - previous.z) * alpha;
+    return result;
+}
+
+bool isRotationKey(sf::Keyboard::Key key) {
+    return key == sf::Keyboard::Left || key == sf::Keyboard::Right ||
+           key == sf::Keyboard::Up || key == sf::Keyboard::Down ||
+           key == sf::Keyboard::W || key == sf::Keyboard::S;
+}
+
+void renderCube(const CubeMesh& cube, const Rotation& rotation) {
+    // Очищаем экран
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Применяем матрицы для вращения
+    glLoadIdentity(); // Сброс матрицы модели
+    glTranslatef(0.0f, 0.0f, -5.0f); // Перемещаем куб
+
+    // Вращаем куб вокруг осей X, Y, Z
+    glRotatef(rotation.x, 1.0f, 0.0f, 0.0f);
+    glRotatef(rotation.y, 0.0f, 1.0f, 0.0f);
+    glRotatef(rotation.z, 0.0f, 0.0f, 1.0f);
+
+    // Отрисовываем куб
+    cube.draw();
+}
+
+// Ограничение частоты кадров: до начала следующего кадра поток спит, а не
+// крутится в цикле. Сроки отсчитываются от предыдущего срока, а не от момента
+// пробуждения, чтобы погрешность сна не накапливалась.
+class FramePacer {
+public:
+    explicit FramePacer(double framesPerSecond)
+        : period(framesPerSecond > 0.0 ? 1.0 / framesPerSecond : 0.0), deadline(Clock::now()) {}
+
+    void wait() {
+        if (period <= 0.0) return;
+
+        deadline += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period));
+        Clock::time_point now = Clock::now();
+        if (deadline > now) {
+            sleptSeconds += secondsBetween(now, deadline);
+            // sf::sleep на Windows повышает точность системного таймера
+            sf::sleep(sf::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count()));
+        } else if (now - deadline > std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period))) {
+            // Отстали больше чем на кадр: не пытаемся наверстать пачкой кадров
+            deadline = now;
+        }
+    }
+
+    double sleptSeconds = 0.0;
+
+private:
+    double period;
+    Clock::time_point deadline;
+};
+
+const char* const usage =
+    "Usage:\n"
+    "  lab_3                       rotating cube, arrow keys rotate it\n"
+    "  lab_3 --fps N               frame rate limit, 0 for unlimited (default 60)\n"
+    "  lab_3 --vsync               enable vertical sync\n"
+    "  lab_3 --profile-csv FILE    also dump per-frame CPU/GPU times as CSV\n"
+    "Offscreen rendering:\n";
+
+int main(int argc, char** argv) {
+    // Замер времени кадров; --profile-csv FILE дополнительно пишет каждый кадр в CSV.
+    // --fps N ограничивает частоту кадров (0 - без ограничения), --vsync
+    // включает вертикальную синхронизацию. --headless, --frames N и остальные
+    // ключи OffscreenOptions рисуют кадры без окна и сохраняют их в файлы
+    std::string profileCsvPath;
+    double targetFps = 60.0;
+    bool vsync = false;
+    OffscreenOptions offscreen;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (offscreen.parseArgument(argc, argv, i)) continue;
+        if (arg == "--profile-csv" && i + 1 < argc) profileCsvPath = argv[++i];
+        else if (arg == "--fps" && i + 1 < argc) targetFps = std::max(0.0, std::atof(argv[++i]));
+        else if (arg == "--vsync") vsync = true;
+        else {
+            std::cerr << "ERROR::LAB_3::UNKNOWN_ARGUMENT " << arg << std::endl << usage << OffscreenOptions::usage;
+            return 1;
+        }
+    }
+    if (offscreen.headless && offscreen.frames == 0) {
+        std::cerr << "ERROR::LAB_3::HEADLESS_NEEDS_FRAMES use --frames N" << std::endl;
+        return 1;
+    }
+
+    auto context = RenderContext::create(
+        offscreen.headless ? RenderContext::Backend::Headless : RenderContext::Backend::Windowed,
+        800, 600, "SFML/OpenGL Cube Rotation", sf::Style::Default, sf::ContextSettings(24, 8, 4, 3, 3));
+    if (!context) return 1;
 
     // Инициализируем OpenGL
     initOpenGL();
+    CubeMesh cube(context->loader());
+
+    // Без окна ввода нет: куб вращается так, будто зажаты Right и Up, и
+    // каждый кадр - это 1/60 секунды
+    if (offscreen.frames > 0) {
+        bool matches = renderOffscreen(context->loader(), offscreen.width, offscreen.height, offscreen, [&](unsigned frame) {
+            Rotation rotation;
+            rotation.x = -rotationSpeed * frame / 60.0f;
+            rotation.y = rotationSpeed * frame / 60.0f;
+            renderCube(cube, rotation);
+        });
+        return matches ? 0 : 1;
+    }
+
+    sf::Window& window = *context->window();
+    FrameProfiler profiler(context->loader());
+    if (!profileCsvPath.empty()) profiler.openCsv(profileCsvPath);
+    window.setVerticalSyncEnabled(vsync);
+    FramePacer pacer(targetFps);
+
+    Rotation previous, current;
+    double accumulator = 0.0;
+
+    // Задержка от получения нажатия до возврата из display() для кадра,
+    // который уже учитывает это нажатие
+    std::vector<double> inputLatencies;
+    bool inputPending = false;
+    bool inputSimulated = false;
+    Clock::time_point inputTime;
+
+    Clock::time_point startTime = Clock::now();
+    Clock::time_point lastTime = startTime;
+    double startCpu = processCpuSeconds();
+    long long frames = 0;
 
     while (window.isOpen()) {
         sf::Event event;
@@ -99,29 +343,65 @@ int main() {
             if (event.type == sf::Event::Closed) {
                 window.close();
             }
+            if (event.type == sf::Event::KeyPressed && isRotationKey(event.key.code) && !inputPending) {
+                inputPending = true;
+                inputSimulated = false;
+                inputTime = Clock::now();
+            }
         }
 
-        // Обновляем вращение
-        updateRotation();
-
-        // Очищаем экран
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Обновляем вращение фиксированными шагами
+        Clock::time_point now = Clock::now();
+        accumulator += std::min(secondsBetween(lastTime, now), maxFrameTime);
+        lastTime = now;
+        while (accumulator >= simulationStep) {
+            previous = current;
+            updateRotation(current, static_cast<float>(simulationStep));
+            accumulator -= simulationStep;
+            if (inputPending) inputSimulated = true;
+        }
+        Rotation rotation = interpolate(previous, current, static_cast<float>(accumulator / simulationStep));
 
-        // Применяем матрицы для вращения
-        glLoadIdentity(); // Сброс матрицы модели
-        glTranslatef(0.0f, 0.0f, -5.0f); // Перемещаем куб
+        profiler.beginFrame();
 
-        // Вращаем куб вокруг осей X, Y, Z
-        glRotatef(angleX, 1.0f, 0.0f, 0.0f);
-        glRotatef(angleY, 0.0f, 1.0f, 0.0f);
-        glRotatef(angleZ, 0.0f, 0.0f, 1.0f);
+        renderCube(cube, rotation);
 
-        // Отрисовываем куб
-        drawCube();
+        profiler.endFrame();
 
         // Отображаем кадр
         window.display();
+        ++frames;
+
+        if (inputPending && inputSimulated) {
+            inputLatencies.push_back(secondsBetween(inputTime, Clock::now()) * 1000.0);
+            inputPending = false;
+        }
+
+        pacer.wait();
     }
 
+    profiler.report(std::cout);
+
+    // Загрузка процессора: процессорное время процесса к реальному
+    double wallSeconds = secondsBetween(startTime, Clock::now());
+    double endCpu = processCpuSeconds();
+    if (wallSeconds > 0.0) {
+        std::cout << "[PACING] " << frames << " frames in " << wallSeconds << " s ("
+                  << frames / wallSeconds << " fps, target ";
+        if (targetFps > 0.0) std::cout << targetFps;
+        else std::cout << "unlimited";
+        std::cout << "), asleep " << 100.0 * pacer.sleptSeconds / wallSeconds << "% of the time" << std::endl;
+        if (startCpu >= 0.0 && endCpu >= 0.0) {
+            std::cout << "[PACING] CPU usage " << 100.0 * (endCpu - startCpu) / wallSeconds << "% of one core" << std::endl;
+        } else {
+            std::cout << "[PACING] CPU usage unavailable" << std::endl;
+        }
+    }
+    if (!inputLatencies.empty()) {
+        std::cout << "[PACING] input to display ms: p50 " << FrameProfiler::percentile(inputLatencies, 0.50)
+                  << "  p95 " << FrameProfiler::percentile(inputLatencies, 0.95)
+                  << "  max " << *std::max_element(inputLatencies.begin(), inputLatencies.end())
+                  << "  (" << inputLatencies.size() << " key presses)" << std::endl;
+    }
     return 0;
 }
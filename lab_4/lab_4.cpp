@@ -5,37 +5,82 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include "mesh.h"
+#include "software_rasterizer.h"
+#include "frame_profiler.h"
+#include "offscreen_target.h"
+#include "render_context.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <memory>
+
+// Shared by every lab_4 shader: the GLSL version and the std140 uniform blocks
+// mirrored by FrameUniforms and ObjectUniforms below.
+const char* shaderPreludeSource = R"(#version 330 core
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 lightDir;
+    vec3 lightColor;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+    vec3 objectColor;
+};
+)";
 
 const char* vertexShaderSource = R"(
-#version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 
 out vec3 FragPos;
 out vec3 Normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(normalMatrix) * aNormal;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
+)";
+
+// Instanced variant: model and normal matrices come from a per-instance vertex
+// buffer, so the normal matrix is computed once per cube on the CPU instead of
+// once per vertex.
+const char* instancedVertexShaderSource = R"(
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in mat4 aModel;        // locations 2..5
+layout (location = 6) in mat3 aNormalMatrix; // locations 6..8
+
+out vec3 FragPos;
+out vec3 Normal;
+
+void main() {
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    Normal = aNormalMatrix * aNormal;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
 )";
 
 const char* fragmentShaderSource = R"(
-#version 330 core
 in vec3 FragPos;
 in vec3 Normal;
 
 out vec4 FragColor;
 
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-uniform vec3 objectColor;
-
 void main() {
     float ambientStrength = 0.2;
     vec3 ambient = ambientStrength * lightColor;
@@ -50,6 +95,24 @@ void main() {
 }
 )";
 
+// CPU mirrors of the std140 blocks in shaderPreludeSource. vec3 members are
+// stored as vec4 because std140 pads them to 16 bytes.
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 lightDir;
+    glm::vec4 lightColor;
+};
+
+struct ObjectUniforms {
+    glm::mat4 model;
+    glm::mat4 normalMatrix; // mat3 in the upper-left corner
+    glm::vec4 objectColor;
+};
+
+const GLuint frameDataBinding = 0;
+const GLuint objectDataBinding = 1;
+
 void createCube(GLuint& VAO, GLuint& VBO) {
     float vertices[] = {
         // positions          // normals
@@ -121,8 +184,9 @@ void createCube(GLuint& VAO, GLuint& VBO) {
 }
 
 GLuint compileShader(GLenum type, const char* source) {
+    const char* sources[] = { shaderPreludeSource, source };
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
+    glShaderSource(shader, 2, sources, nullptr);
     glCompileShader(shader);
 
     int success;
@@ -135,70 +199,1081 @@ GLuint compileShader(GLenum type, const char* source) {
     return shader;
 }
 
-int main() {
-    sf::Window window(sf::VideoMode(800, 600), "3D Cube with Lighting", sf::Style::Close | sf::Style::Resize, sf::ContextSettings(24));
-    glewInit();
-    glEnable(GL_DEPTH_TEST);
+GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    if (GLEW_ARB_get_program_binary) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
 
-    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cerr << "ERROR::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
 
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+    return program;
+}
+
+// Builds programs from source and keeps their linked binaries on disk
+// (glGetProgramBinary/glProgramBinary), so later launches skip compiling and
+// linking. Binaries are keyed by the shader sources and the driver; a binary
+// the driver rejects is simply rebuilt and overwritten.
+class ShaderCache {
+public:
+    explicit ShaderCache(const std::string& directory) : directory(directory) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = GLEW_ARB_get_program_binary && formats > 0;
+        if (enabled) {
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            if (error) disable("cannot create " + directory + ": " + error.message());
+        }
+    }
+
+    // shader_cache next to the executable, so the cache doesn't depend on the
+    // working directory; argv0 is the fallback where /proc/self/exe is missing
+    static std::string defaultDirectory(const char* argv0) {
+        std::error_code error;
+        std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", error);
+        if (error) executable = std::filesystem::absolute(argv0, error);
+        return (executable.parent_path() / "shader_cache").string();
+    }
+
+    GLuint getProgram(const char* vertexSource, const char* fragmentSource) {
+        std::string path = directory + "/" + cacheKey(vertexSource, fragmentSource) + ".bin";
+
+        GLuint program = enabled ? loadBinary(path) : 0;
+        if (program) {
+            ++hits;
+        } else {
+            program = createProgram(vertexSource, fragmentSource);
+            if (enabled) saveBinary(program, path);
+            ++misses;
+        }
+
+        // Block bindings are program state that binaries are not required to keep
+        GLuint frameIndex = glGetUniformBlockIndex(program, "FrameData");
+        if (frameIndex != GL_INVALID_INDEX) glUniformBlockBinding(program, frameIndex, frameDataBinding);
+        GLuint objectIndex = glGetUniformBlockIndex(program, "ObjectData");
+        if (objectIndex != GL_INVALID_INDEX) glUniformBlockBinding(program, objectIndex, objectDataBinding);
+        return program;
+    }
+
+    int cacheHits() const { return hits; }
+    int cacheMisses() const { return misses; }
+
+private:
+    struct BinaryHeader {
+        char magic[4];
+        GLenum format;
+        GLint length;
+    };
+
+    // FNV-1a over everything that can invalidate a binary
+    std::string cacheKey(const char* vertexSource, const char* fragmentSource) const {
+        const char* parts[] = {
+            shaderPreludeSource, vertexSource, fragmentSource,
+            reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+            reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+            reinterpret_cast<const char*>(glGetString(GL_VERSION)),
+        };
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const char* part : parts) {
+            for (const char* c = part; c && *c; ++c) {
+                hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+            }
+            hash = (hash ^ 0xFF) * 1099511628211ull;
+        }
+        std::ostringstream key;
+        key << std::hex << hash;
+        return key.str();
+    }
+
+    GLuint loadBinary(const std::string& path) const {
+        std::ifstream file(path, std::ios::binary);
+        BinaryHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, "L4PB", 4) != 0 || header.length <= 0) {
+            return 0;
+        }
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), header.length)) {
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), header.length);
+        int success;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void saveBinary(GLuint program, const std::string& path) {
+        BinaryHeader header = { { 'L', '4', 'P', 'B' }, 0, 0 };
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+        if (header.length <= 0) return;
+
+        std::vector<char> binary(header.length);
+        glGetProgramBinary(program, header.length, nullptr, &header.format, binary.data());
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), header.length);
+        if (!file) disable("cannot write " + path);
+    }
+
+    // Reported once; programs are compiled from source from then on
+    void disable(const std::string& reason) {
+        std::cerr << "ERROR::SHADER_CACHE::DISABLED " << reason << std::endl;
+        enabled = false;
+    }
+
+    std::string directory;
+    bool enabled = false;
+    int hits = 0;
+    int misses = 0;
+};
+
+// CPU copy of a uniform block. update() only marks the buffer dirty when the
+// contents actually change, and flush() uploads dirty data once.
+template <typename T>
+class UniformBuffer {
+public:
+    explicit UniformBuffer(GLuint binding) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+    ~UniformBuffer() {
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void update(const T& value) {
+        if (!hasData || std::memcmp(&value, &data, sizeof(T)) != 0) {
+            data = value;
+            hasData = true;
+            dirty = true;
+        }
+    }
+
+    void flush() {
+        if (!dirty) return;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        dirty = false;
+        ++uploads;
+    }
+
+    int uploadCount() const { return uploads; }
+
+private:
+    GLuint buffer = 0;
+    T data;
+    bool hasData = false;
+    bool dirty = false;
+    int uploads = 0;
+};
+
+FrameUniforms makeFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDir, const glm::vec3& lightColor) {
+    FrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.lightDir = glm::vec4(lightDir, 0.0f);
+    frame.lightColor = glm::vec4(lightColor, 0.0f);
+    return frame;
+}
+
+ObjectUniforms makeObjectUniforms(const glm::mat4& model, const glm::vec3& objectColor) {
+    ObjectUniforms object;
+    object.model = model;
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    object.normalMatrix = glm::mat4(1.0f);
+    for (int i = 0; i < 3; ++i) {
+        object.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+    }
+    object.objectColor = glm::vec4(objectColor, 0.0f);
+    return object;
+}
+
+// An indexed (or, with ebo == 0, plain) triangle mesh on the GPU
+struct GpuMesh {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLsizei count = 0; // indices, or vertices when there is no index buffer
+    GLenum indexType = GL_UNSIGNED_INT;
+};
+
+// vertices is an array of MeshVertex; indices may be null for non-indexed meshes
+GpuMesh uploadMesh(const void* vertices, size_t vertexBytes, const void* indices, size_t indexCount, size_t indexSize) {
+    GpuMesh mesh;
+    glGenVertexArrays(1, &mesh.vao);
+    glGenBuffers(1, &mesh.vbo);
+
+    glBindVertexArray(mesh.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    if (indices) {
+        glGenBuffers(1, &mesh.ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
+        mesh.count = static_cast<GLsizei>(indexCount);
+        mesh.indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    } else {
+        mesh.count = static_cast<GLsizei>(vertexBytes / sizeof(MeshVertex));
+    }
+
+    glBindVertexArray(0);
+    return mesh;
+}
+
+GpuMesh uploadMesh(const Mesh& mesh, bool indexed = true) {
+    return uploadMesh(mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex),
+                      indexed ? mesh.indices.data() : nullptr, mesh.indices.size(), sizeof(uint32_t));
+}
+
+// The binary file is mapped, not read: glBufferData copies straight out of the page cache
+GpuMesh uploadMesh(const MappedMesh& mesh) {
+    return uploadMesh(mesh.vertexData(), mesh.vertexBytes(), mesh.indexData(),
+                      mesh.header().indexCount, mesh.header().indexSize);
+}
+
+void drawMesh(const GpuMesh& mesh) {
+    glBindVertexArray(mesh.vao);
+    if (mesh.ebo) {
+        glDrawElements(GL_TRIANGLES, mesh.count, mesh.indexType, nullptr);
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, mesh.count);
+    }
+    glBindVertexArray(0);
+}
+
+void deleteMesh(GpuMesh& mesh) {
+    glDeleteVertexArrays(1, &mesh.vao);
+    glDeleteBuffers(1, &mesh.vbo);
+    if (mesh.ebo) glDeleteBuffers(1, &mesh.ebo);
+    mesh = GpuMesh();
+}
+
+// Scales and centers a mesh with the given bounds into the unit cube at the origin
+glm::mat4 fitToUnitCube(const float* boundsMin, const float* boundsMax) {
+    glm::vec3 low(boundsMin[0], boundsMin[1], boundsMin[2]);
+    glm::vec3 high(boundsMax[0], boundsMax[1], boundsMax[2]);
+    glm::vec3 size = high - low;
+    float extent = std::max(size.x, std::max(size.y, size.z));
+    float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+    return glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(scale)), -(low + high) * 0.5f);
+}
+
+// Loads a .mesh file through a memory mapping, or imports and optimizes an OBJ
+bool loadGpuMesh(const std::string& path, GpuMesh& gpuMesh, glm::mat4& model) {
+    if (path.size() > 5 && path.compare(path.size() - 5, 5, ".mesh") == 0) {
+        MappedMesh mapped;
+        if (!mapped.open(path)) return false;
+        gpuMesh = uploadMesh(mapped);
+        model = fitToUnitCube(mapped.header().boundsMin, mapped.header().boundsMax);
+        return true;
+    }
+
+    Mesh mesh;
+    if (!loadObj(path, mesh)) return false;
+    optimizeMesh(mesh);
+    float boundsMin[3], boundsMax[3];
+    computeBounds(mesh, boundsMin, boundsMax);
+    gpuMesh = uploadMesh(mesh);
+    model = fitToUnitCube(boundsMin, boundsMax);
+    return true;
+}
+
+// OBJ -> optimized binary mesh, without a GL context
+int convertMesh(const std::string& objPath, const std::string& meshPath) {
+    Mesh mesh;
+    if (!loadObj(objPath, mesh)) return 1;
+    float acmrBefore = computeAcmr(mesh.indices, mesh.vertices.size());
+    optimizeMesh(mesh);
+    float acmrAfter = computeAcmr(mesh.indices, mesh.vertices.size());
+    if (!writeMeshFile(meshPath, mesh)) return 1;
+
+    std::cout << objPath << " -> " << meshPath << ": " << mesh.vertices.size() << " vertices, "
+              << mesh.indices.size() / 3 << " triangles, ACMR " << acmrBefore << " -> " << acmrAfter << std::endl;
+    return 0;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Vertex shader invocations for one draw, or -1 without ARB_pipeline_statistics_query
+long long countVertexShaderInvocations(const GpuMesh& mesh) {
+    if (!GLEW_ARB_pipeline_statistics_query) return -1;
+    GLuint query;
+    glGenQueries(1, &query);
+    glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, query);
+    drawMesh(mesh);
+    glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+    GLuint64 invocations = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &invocations);
+    glDeleteQueries(1, &query);
+    return static_cast<long long>(invocations);
+}
+
+double averageDrawMilliseconds(const GpuMesh& mesh, int frames) {
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawMesh(mesh);
+    }
+    glFinish();
+    return millisecondsSince(start) / frames;
+}
+
+// Compares the raw path (every face corner its own vertex, glDrawArrays) with
+// the indexed OBJ import and with the memory-mapped binary mesh. The binary
+// mesh is written to the temp directory and removed afterwards.
+int runMeshBenchmark(const std::string& objPath, ShaderCache& shaderCache) {
+    const int drawFrames = 20;
+
+    auto start = std::chrono::steady_clock::now();
+    Mesh raw;
+    if (!loadObj(objPath, raw, false)) return 1;
+    double rawParse = millisecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    GpuMesh rawGpu = uploadMesh(raw, false);
+    glFinish();
+    double rawUpload = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    Mesh mesh;
+    if (!loadObj(objPath, mesh)) {
+        deleteMesh(rawGpu);
+        return 1;
+    }
+    double indexedParse = millisecondsSince(start);
+    GpuMesh unoptimizedGpu = uploadMesh(mesh);
+    float acmrBefore = computeAcmr(mesh.indices, mesh.vertices.size());
+
+    start = std::chrono::steady_clock::now();
+    optimizeMesh(mesh);
+    double optimize = millisecondsSince(start);
+    float acmrAfter = computeAcmr(mesh.indices, mesh.vertices.size());
+
+    std::error_code error;
+    std::filesystem::path tempDirectory = std::filesystem::temp_directory_path(error);
+    std::string meshPath = (tempDirectory / std::filesystem::path(objPath).filename().replace_extension(".bench.mesh")).string();
+    if (error || !writeMeshFile(meshPath, mesh)) {
+        if (error) std::cerr << "ERROR::LAB_4::NO_TEMP_DIRECTORY " << error.message() << std::endl;
+        deleteMesh(rawGpu);
+        deleteMesh(unoptimizedGpu);
+        return 1;
+    }
+
+    start = std::chrono::steady_clock::now();
+    MappedMesh mapped;
+    GpuMesh binaryGpu;
+    bool opened = mapped.open(meshPath);
+    if (opened) {
+        binaryGpu = uploadMesh(mapped);
+        glFinish();
+    }
+    double binaryLoad = millisecondsSince(start);
+    std::filesystem::remove(meshPath, error);
+    if (!opened) {
+        deleteMesh(rawGpu);
+        deleteMesh(unoptimizedGpu);
+        return 1;
+    }
+
+    float boundsMin[3], boundsMax[3];
+    computeBounds(mesh, boundsMin, boundsMax);
+    GLuint program = shaderCache.getProgram(vertexShaderSource, fragmentShaderSource);
+    glUseProgram(program);
+    UniformBuffer<FrameUniforms> frameData(frameDataBinding);
+    UniformBuffer<ObjectUniforms> objectData(objectDataBinding);
+    frameData.update(makeFrameUniforms(
+        glm::lookAt(glm::vec3(1.2f, 1.2f, 1.8f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+        glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f),
+        glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(1.0f)));
+    objectData.update(makeObjectUniforms(fitToUnitCube(boundsMin, boundsMax), glm::vec3(0.6f, 0.6f, 1.0f)));
+    frameData.flush();
+    objectData.flush();
+
+    std::cout << "Mesh benchmark: " << objPath << " (" << glGetString(GL_RENDERER) << ")" << std::endl
+              << "  triangles: " << mesh.indices.size() / 3
+              << ", raw vertices: " << raw.vertices.size() << ", unique vertices: " << mesh.vertices.size() << std::endl
+              << "  load, raw OBJ:           " << rawParse << " ms parse + " << rawUpload << " ms upload" << std::endl
+              << "  load, indexed OBJ:       " << indexedParse << " ms parse + " << optimize << " ms optimize" << std::endl
+              << "  load, binary mesh (mmap): " << binaryLoad << " ms including upload" << std::endl
+              << "  ACMR (FIFO 16):          " << acmrBefore << " before, " << acmrAfter << " after optimization" << std::endl;
+
+    const GpuMesh* variants[] = { &rawGpu, &unoptimizedGpu, &binaryGpu };
+    const char* names[] = { "raw", "indexed", "indexed + optimized" };
+    for (int i = 0; i < 3; ++i) {
+        long long invocations = countVertexShaderInvocations(*variants[i]);
+        std::cout << "  " << names[i] << ": vertex shader invocations "
+                  << (invocations >= 0 ? std::to_string(invocations) : std::string("n/a"))
+                  << ", draw " << averageDrawMilliseconds(*variants[i], drawFrames) << " ms" << std::endl;
+    }
+
+    deleteMesh(rawGpu);
+    deleteMesh(unoptimizedGpu);
+    deleteMesh(binaryGpu);
+    glDeleteProgram(program);
+    return 0;
+}
+
+// Per-instance attributes, laid out exactly as instancedVertexShaderSource reads them
+struct CubeInstance {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+static_assert(sizeof(CubeInstance) == 25 * sizeof(float), "CubeInstance must be tightly packed");
+
+// Bounding sphere of a unit cube
+const float cubeBoundingRadius = 0.8660254f;
+
+// Fills a roughly cubic grid with count cubes, each with its own orientation.
+// bounds receives a bounding sphere (xyz = center, w = radius) per instance.
+std::vector<CubeInstance> createCubeGrid(int count, float spacing, std::vector<glm::vec4>& bounds) {
+    int side = static_cast<int>(std::ceil(std::cbrt(static_cast<float>(count))));
+    float offset = (side - 1) * spacing * 0.5f;
+
+    std::vector<CubeInstance> instances;
+    instances.reserve(count);
+    bounds.clear();
+    bounds.reserve(count);
+
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 position(
+            (i % side) * spacing - offset,
+            ((i / side) % side) * spacing - offset,
+            (i / (side * side)) * spacing - offset);
+
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+        model = glm::rotate(model, i * 0.37f, glm::vec3(0.3f, 1.0f, 0.5f));
+
+        CubeInstance instance;
+        instance.model = model;
+        instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        instances.push_back(instance);
+        bounds.push_back(glm::vec4(position, cubeBoundingRadius));
+    }
+    return instances;
+}
+
+// Frustum planes (xyz = normal pointing inside, w = distance) in world space
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann plane extraction from a combined projection * view matrix
+Frustum extractFrustum(const glm::mat4& viewProjection) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    }
+
+    Frustum frustum;
+    for (int i = 0; i < 3; ++i) {
+        frustum.planes[2 * i]     = rows[3] + rows[i];
+        frustum.planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4& plane : frustum.planes) {
+        plane = plane / glm::length(glm::vec3(plane.x, plane.y, plane.z));
+    }
+    return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const glm::vec4& sphere) {
+    for (const glm::vec4& plane : frustum.planes) {
+        if (plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w < -sphere.w) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Streams the visible instances to the GPU every frame.
+// With GL_ARB_buffer_storage the buffer is persistently mapped and split into
+// regions guarded by fences, so culling writes straight into GPU-visible memory
+// while the previous frames are still being drawn. Otherwise the buffer is
+// orphaned and refilled with glBufferSubData.
+class InstanceBuffer {
+public:
+    static const int regionCount = 3;
+
+    InstanceBuffer(GLuint cubeVBO, size_t capacity)
+        : capacity(capacity), persistent(GLEW_ARB_buffer_storage) {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &buffer);
+
+        glBindVertexArray(vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        GLsizeiptr regionBytes = capacity * sizeof(CubeInstance);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, regionBytes * regionCount, nullptr, flags);
+            mapped = static_cast<CubeInstance*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, regionBytes * regionCount, flags));
+            persistent = mapped != nullptr;
+        }
+        if (!persistent) {
+            glBufferData(GL_ARRAY_BUFFER, regionBytes, nullptr, GL_STREAM_DRAW);
+            staging.resize(capacity);
+        }
+
+        for (GLuint i = 2; i <= 8; ++i) {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+        bindInstanceAttributes(0);
+
+        glBindVertexArray(0);
+    }
+
+    ~InstanceBuffer() {
+        for (GLsync fence : fences) {
+            if (fence) glDeleteSync(fence);
+        }
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glDeleteBuffers(1, &buffer);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    bool isPersistent() const { return persistent; }
+
+    // Culls instances against the frustum and uploads the visible ones.
+    // Returns the number of instances that will be drawn.
+    size_t upload(const std::vector<CubeInstance>& instances, const std::vector<glm::vec4>& bounds, const Frustum& frustum) {
+        CubeInstance* target = staging.data();
+        if (persistent) {
+            waitForRegion(region);
+            target = mapped + region * capacity;
+        }
+
+        size_t visible = 0;
+        for (size_t i = 0; i < instances.size() && visible < capacity; ++i) {
+            if (sphereInFrustum(frustum, bounds[i])) {
+                target[visible++] = instances[i];
+            }
+        }
+
+        if (!persistent) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(CubeInstance), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, visible * sizeof(CubeInstance), staging.data());
+        }
+        return visible;
+    }
+
+    void draw(GLsizei vertexCount, size_t instanceCount) {
+        glBindVertexArray(vao);
+        if (persistent) {
+            bindInstanceAttributes(region * capacity * sizeof(CubeInstance));
+        }
+        glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, static_cast<GLsizei>(instanceCount));
+        glBindVertexArray(0);
+
+        if (persistent) {
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            region = (region + 1) % regionCount;
+        }
+    }
+
+private:
+    void bindInstanceAttributes(size_t baseOffset) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        GLsizei stride = sizeof(CubeInstance);
+        for (GLuint column = 0; column < 4; ++column) {
+            glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, stride,
+                (void*)(baseOffset + column * sizeof(glm::vec4)));
+        }
+        for (GLuint column = 0; column < 3; ++column) {
+            glVertexAttribPointer(6 + column, 3, GL_FLOAT, GL_FALSE, stride,
+                (void*)(baseOffset + sizeof(glm::mat4) + column * sizeof(glm::vec3)));
+        }
+    }
+
+    void waitForRegion(int index) {
+        if (!fences[index]) return;
+        while (glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(fences[index]);
+        fences[index] = nullptr;
+    }
+
+    GLuint vao = 0;
+    GLuint buffer = 0;
+    size_t capacity;
+    bool persistent;
+    CubeInstance* mapped = nullptr;
+    std::vector<CubeInstance> staging;
+    GLsync fences[regionCount] = {};
+    int region = 0;
+};
+
+glm::mat4 orbitView(float angle, float radius, float height) {
+    glm::vec3 eye(radius * std::sin(angle), height, radius * std::cos(angle));
+    return glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// Renders grids of 1k, 10k and 100k cubes from an orbiting camera and reports
+// CPU culling/upload time, draw time (until glFinish returns) and throughput.
+void runInstancingBenchmark(GLuint cubeVBO, ShaderCache& shaderCache) {
+    const int counts[] = { 1000, 10000, 100000 };
+    const int warmupFrames = 10;
+    const int measuredFrames = 100;
+    const float spacing = 2.0f;
+    const glm::vec3 lightDir(1.0f, -1.0f, -1.0f);
+    const glm::vec3 lightColor(1.0f);
+
+    GLuint program = shaderCache.getProgram(instancedVertexShaderSource, fragmentShaderSource);
+    glUseProgram(program);
+
+    UniformBuffer<FrameUniforms> frameData(frameDataBinding);
+    UniformBuffer<ObjectUniforms> objectData(objectDataBinding);
+    objectData.update(makeObjectUniforms(glm::mat4(1.0f), glm::vec3(0.6f, 0.6f, 1.0f)));
+    objectData.flush();
+
+    std::cout << "Instancing benchmark (" << glGetString(GL_RENDERER) << ")" << std::endl;
+
+    for (int count : counts) {
+        std::vector<glm::vec4> bounds;
+        std::vector<CubeInstance> instances = createCubeGrid(count, spacing, bounds);
+        InstanceBuffer instanceBuffer(cubeVBO, instances.size());
+
+        float extent = std::cbrt(static_cast<float>(count)) * spacing;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, extent * 4.0f);
+
+        double cullSeconds = 0.0, drawSeconds = 0.0;
+        size_t drawnInstances = 0;
+
+        for (int frame = 0; frame < warmupFrames + measuredFrames; ++frame) {
+            glm::mat4 view = orbitView(frame * 0.05f, extent * 0.9f, extent * 0.3f);
+            frameData.update(makeFrameUniforms(view, projection, lightDir, lightColor));
+            frameData.flush();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            auto start = std::chrono::steady_clock::now();
+            size_t visible = instanceBuffer.upload(instances, bounds, extractFrustum(projection * view));
+            auto culled = std::chrono::steady_clock::now();
+            instanceBuffer.draw(36, visible);
+            glFinish();
+            auto finished = std::chrono::steady_clock::now();
+
+            if (frame >= warmupFrames) {
+                cullSeconds += std::chrono::duration<double>(culled - start).count();
+                drawSeconds += std::chrono::duration<double>(finished - culled).count();
+                drawnInstances += visible;
+            }
+        }
+
+        std::cout << "  " << count << " cubes ("
+                  << (instanceBuffer.isPersistent() ? "persistent map" : "buffer orphaning") << "): "
+                  << "visible " << drawnInstances / measuredFrames
+                  << ", cull+upload " << cullSeconds * 1000.0 / measuredFrames << " ms"
+                  << ", draw " << drawSeconds * 1000.0 / measuredFrames << " ms"
+                  << ", " << static_cast<long long>(drawnInstances / (cullSeconds + drawSeconds)) << " instances/sec"
+                  << std::endl;
+    }
+
+    glDeleteProgram(program);
+}
+
+// ---------------------------------------------------------------------------
+// Software rasterizer
+// ---------------------------------------------------------------------------
+
+// The single-object scene of main(): same camera, projection and light
+SoftwareUniforms makeSoftwareUniforms(const glm::mat4& model) {
+    SoftwareUniforms uniforms;
+    uniforms.model = model;
+    uniforms.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    uniforms.projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    uniforms.lightDir = glm::vec3(1.0f, -1.0f, -1.0f);
+    uniforms.lightColor = glm::vec3(1.0f);
+    uniforms.objectColor = glm::vec3(0.6f, 0.6f, 1.0f);
+    return uniforms;
+}
+
+// CPU counterpart of loadGpuMesh
+bool loadCpuMesh(const std::string& path, Mesh& mesh, glm::mat4& model) {
+    float boundsMin[3], boundsMax[3];
+    if (path.size() > 5 && path.compare(path.size() - 5, 5, ".mesh") == 0) {
+        MappedMesh mapped;
+        if (!mapped.open(path)) return false;
+        const MeshFileHeader& header = mapped.header();
+        const MeshVertex* vertices = static_cast<const MeshVertex*>(mapped.vertexData());
+        mesh.vertices.assign(vertices, vertices + header.vertexCount);
+        mesh.indices.resize(header.indexCount);
+        for (uint32_t i = 0; i < header.indexCount; ++i) {
+            mesh.indices[i] = header.indexSize == 2 ? static_cast<const uint16_t*>(mapped.indexData())[i]
+                                                    : static_cast<const uint32_t*>(mapped.indexData())[i];
+        }
+        std::copy(header.boundsMin, header.boundsMin + 3, boundsMin);
+        std::copy(header.boundsMax, header.boundsMax + 3, boundsMax);
+    } else {
+        if (!loadObj(path, mesh)) return false;
+        optimizeMesh(mesh);
+        computeBounds(mesh, boundsMin, boundsMax);
+    }
+    model = fitToUnitCube(boundsMin, boundsMax);
+    return true;
+}
+
+// Renders the cube (or meshPath) on the CPU only, without any GL context, and
+// writes the frames like renderOffscreen does
+int runSoftwareRenderer(const std::string& meshPath, const OffscreenOptions& options) {
+    Mesh mesh;
+    glm::mat4 model(1.0f);
+    if (meshPath.empty()) {
+        mesh = createSubdividedCube(1);
+    } else if (!loadCpuMesh(meshPath, mesh, model)) {
+        return 1;
+    }
+    SoftwareUniforms uniforms = makeSoftwareUniforms(model);
+
+    std::error_code error;
+    std::filesystem::create_directories(options.outputDirectory, error);
+    if (error) {
+        std::cerr << "ERROR::SOFTWARE::OUTPUT_DIRECTORY " << options.outputDirectory << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    SoftwareRasterizer rasterizer(options.width, options.height);
+    unsigned frames = std::max(1u, options.frames);
+    double totalMilliseconds = 0.0;
+    bool matches = true;
+    bool written = true;
+    for (unsigned frame = 0; frame < frames; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        rasterizer.clear();
+        rasterizer.draw(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), uniforms);
+        totalMilliseconds += millisecondsSince(start);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%04u.ppm", frame);
+        std::string path = (std::filesystem::path(options.outputDirectory) / name).string();
+        if (!writePpm(path, rasterizer.pixels(), options.width, options.height)) {
+            std::cerr << "ERROR::SOFTWARE::WRITE_FAILED " << path << std::endl;
+            written = false;
+        }
+
+        if (!options.referenceDirectory.empty()) {
+            int largestDifference = 0;
+            long long differentPixels = countDifferingPixels(
+                (std::filesystem::path(options.referenceDirectory) / name).string(),
+                rasterizer.pixels(), options.width, options.height, options.tolerance, &largestDifference);
+            if (!options.matchesReference(differentPixels)) {
+                std::cerr << "ERROR::SOFTWARE::IMAGE_MISMATCH " << name << ": "
+                          << (differentPixels < 0 ? std::string("no reference") : std::to_string(differentPixels) + " pixels differ")
+                          << ", largest difference " << largestDifference << std::endl;
+                matches = false;
+            }
+        }
+    }
+
+    std::cout << "[SOFTWARE] " << frames << " frames, " << mesh.indices.size() / 3 << " triangles, "
+              << rasterizer.threadCount() << " threads: " << totalMilliseconds / frames << " ms per frame -> "
+              << options.outputDirectory << std::endl;
+    return matches && written ? 0 : 1;
+}
+
+// Pixels of two RGBA images differing by more than tolerance in some channel
+size_t compareImages(const std::vector<unsigned char>& a, const unsigned char* b, int tolerance, int& largestDifference) {
+    size_t differentPixels = 0;
+    largestDifference = 0;
+    for (size_t pixel = 0; pixel < a.size() / 4; ++pixel) {
+        int difference = 0;
+        for (int c = 0; c < 3; ++c) {
+            difference = std::max(difference, std::abs(a[pixel * 4 + c] - b[pixel * 4 + c]));
+        }
+        largestDifference = std::max(largestDifference, difference);
+        if (difference > tolerance) ++differentPixels;
+    }
+    return differentPixels;
+}
+
+// Draws cubes split into 12 to 3M triangles through GL and through the
+// software rasterizer (single-threaded and on every hardware thread) and
+// compares frame times and images
+void runSoftwareBenchmark(OffscreenTarget::GlLoader loader, ShaderCache& shaderCache) {
+    const int divisions[] = { 1, 32, 128, 512 };
+    const int frames = 5;
+    const int tolerance = 2;
+
+    SoftwareUniforms uniforms = makeSoftwareUniforms(glm::mat4(1.0f));
+
+    GLuint program = shaderCache.getProgram(vertexShaderSource, fragmentShaderSource);
+    glUseProgram(program);
+    UniformBuffer<FrameUniforms> frameData(frameDataBinding);
+    UniformBuffer<ObjectUniforms> objectData(objectDataBinding);
+    frameData.update(makeFrameUniforms(uniforms.view, uniforms.projection, uniforms.lightDir, uniforms.lightColor));
+    objectData.update(makeObjectUniforms(uniforms.model, uniforms.objectColor));
+    frameData.flush();
+    objectData.flush();
+
+    OffscreenTarget target(loader, 800, 600);
+    if (!target.isComplete()) return;
+    target.bind();
+
+    SoftwareRasterizer serial(800, 600, 1);
+    SoftwareRasterizer parallel(800, 600);
+    std::vector<unsigned char> glPixels(800 * 600 * 4);
+
+    std::cout << "Software rasterizer benchmark (GL: " << glGetString(GL_RENDERER) << ", "
+              << parallel.threadCount() << " hardware threads)" << std::endl;
+
+    for (int division : divisions) {
+        Mesh mesh = createSubdividedCube(division);
+        GpuMesh gpuMesh = uploadMesh(mesh);
+
+        drawMesh(gpuMesh); // warm up
+        double glMilliseconds = averageDrawMilliseconds(gpuMesh, frames);
+        glReadPixels(0, 0, 800, 600, GL_RGBA, GL_UNSIGNED_BYTE, glPixels.data());
+        deleteMesh(gpuMesh);
+
+        SoftwareRasterizer* rasterizers[] = { &serial, &parallel };
+        double softwareMilliseconds[2];
+        for (int r = 0; r < 2; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < frames; ++frame) {
+                rasterizers[r]->clear();
+                rasterizers[r]->draw(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), uniforms);
+            }
+            softwareMilliseconds[r] = millisecondsSince(start) / frames;
+        }
+
+        int largestDifference = 0;
+        size_t differentPixels = compareImages(glPixels, parallel.pixels(), tolerance, largestDifference);
+
+        std::cout << "  " << mesh.indices.size() / 3 << " triangles: GL " << glMilliseconds << " ms"
+                  << ", software " << softwareMilliseconds[0] << " ms (1 thread), "
+                  << softwareMilliseconds[1] << " ms (" << parallel.threadCount() << " threads)"
+                  << ", " << differentPixels << " pixels differ by more than " << tolerance
+                  << " (largest " << largestDifference << ")" << std::endl;
+    }
+
+    target.unbind();
+    glDeleteProgram(program);
+}
+
+const char* const usage =
+    "Usage:\n"
+    "  lab_4                       single lit cube\n"
+    "  lab_4 --mesh FILE           lit OBJ or binary .mesh model instead of the cube\n"
+    "  lab_4 --convert OBJ MESH    import, optimize and write a binary mesh\n"
+    "  lab_4 --instances N         N instanced cubes seen from an orbiting camera (not with --mesh)\n"
+    "  lab_4 --bench-instancing    instancing benchmark at 1k, 10k and 100k cubes\n"
+    "  lab_4 --bench-mesh OBJ      raw vs indexed vs binary mesh benchmark\n"
+    "  lab_4 --profile-csv FILE    also dump per-frame CPU/GPU times as CSV\n"
+    "  lab_4 --shader-cache DIR    program binary cache (default: shader_cache next to lab_4)\n"
+    "  lab_4 --software            render the cube or --mesh on the CPU only\n"
+    "  lab_4 --bench-software      GL vs software rasterizer at 12 to 3M triangles\n"
+    "Offscreen rendering (also with --software):\n";
+
+int main(int argc, char** argv) {
+    int instanceCount = 0;
+    bool benchmark = false;
+    std::string meshPath;
+    std::string benchMeshPath;
+    std::string profileCsvPath;
+    std::string shaderCachePath;
+    bool software = false;
+    bool benchSoftware = false;
+    OffscreenOptions offscreen;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (offscreen.parseArgument(argc, argv, i)) continue;
+        if (arg == "--instances" && i + 1 < argc) instanceCount = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--profile-csv" && i + 1 < argc) profileCsvPath = argv[++i];
+        else if (arg == "--shader-cache" && i + 1 < argc) shaderCachePath = argv[++i];
+        else if (arg == "--bench-instancing") benchmark = true;
+        else if (arg == "--mesh" && i + 1 < argc) meshPath = argv[++i];
+        else if (arg == "--bench-mesh" && i + 1 < argc) benchMeshPath = argv[++i];
+        else if (arg == "--software") software = true;
+        else if (arg == "--bench-software") benchSoftware = true;
+        else if (arg == "--convert" && i + 2 < argc) return convertMesh(argv[i + 1], argv[i + 2]);
+        else {
+            std::cerr << "ERROR::LAB_4::UNKNOWN_ARGUMENT " << arg << std::endl << usage << OffscreenOptions::usage;
+            return 1;
+        }
+    }
+    if (!meshPath.empty() && instanceCount > 0) {
+        std::cerr << "ERROR::LAB_4::MESH_WITH_INSTANCES --instances only draws cubes" << std::endl
+                  << usage << OffscreenOptions::usage;
+        return 1;
+    }
+
+    if (software) return runSoftwareRenderer(meshPath, offscreen);
+
+    bool offscreenBenchmark = benchmark || !benchMeshPath.empty() || benchSoftware;
+    if (offscreen.headless && offscreen.frames == 0 && !offscreenBenchmark) {
+        std::cerr << "ERROR::LAB_4::HEADLESS_NEEDS_FRAMES use --frames N or one of the --bench options" << std::endl;
+        return 1;
+    }
+
+    auto context = RenderContext::create(
+        offscreen.headless ? RenderContext::Backend::Headless : RenderContext::Backend::Windowed,
+        800, 600, "3D Cube with Lighting", sf::Style::Close | sf::Style::Resize, sf::ContextSettings(24));
+    if (!context) return 1;
+    // Under EGL a GLX-only GLEW build reports a missing GLX display, but the
+    // GL entry points it needs are already loaded by then
+    glewInit();
+    glEnable(GL_DEPTH_TEST);
 
     GLuint VAO, VBO;
     createCube(VAO, VBO);
 
+    ShaderCache shaderCache(shaderCachePath.empty() ? ShaderCache::defaultDirectory(argv[0]) : shaderCachePath);
+
+    if (offscreenBenchmark) {
+        int result = 0;
+        if (benchmark) runInstancingBenchmark(VBO, shaderCache);
+        if (!benchMeshPath.empty()) result = runMeshBenchmark(benchMeshPath, shaderCache);
+        if (benchSoftware) runSoftwareBenchmark(context->loader(), shaderCache);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        return result;
+    }
+
+    auto programStart = std::chrono::steady_clock::now();
+    GLuint shaderProgram = shaderCache.getProgram(
+        instanceCount > 0 ? instancedVertexShaderSource : vertexShaderSource, fragmentShaderSource);
+    std::cout << "Shader program ready in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - programStart).count()
+              << " ms (" << (shaderCache.cacheHits() > 0 ? "binary cache" : "compiled from source") << ")" << std::endl;
+
+    UniformBuffer<FrameUniforms> frameData(frameDataBinding);
+    UniformBuffer<ObjectUniforms> objectData(objectDataBinding);
+
+    std::vector<glm::vec4> instanceBounds;
+    std::vector<CubeInstance> instances;
+    std::unique_ptr<InstanceBuffer> instanceBuffer;
+    float gridExtent = 0.0f;
+    if (instanceCount > 0) {
+        instances = createCubeGrid(instanceCount, 2.0f, instanceBounds);
+        instanceBuffer.reset(new InstanceBuffer(VBO, instances.size()));
+        gridExtent = std::cbrt(static_cast<float>(instanceCount)) * 2.0f;
+    }
+
     glm::vec3 lightDir(1.0f, -1.0f, -1.0f);
     glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
     glm::vec3 objectColor(0.6f, 0.6f, 1.0f);
 
 
     glm::mat4 model = glm::mat4(1.0f);
+    GpuMesh mesh;
+    if (!meshPath.empty() && !loadGpuMesh(meshPath, mesh, model)) {
+        return 1;
+    }
+
     glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 2.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
-
-    bool running = true;
-    while (running) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                running = false;
-            }
-        }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, std::max(100.0f, gridExtent * 4.0f));
+    float orbitAngle = 0.0f;
 
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) lightDir.y += 0.1f;
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) lightDir.y -= 0.1f;
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) lightDir.x -= 0.1f;
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) lightDir.x += 0.1f;
+    // The cube never moves, so its block is uploaded once
+    objectData.update(makeObjectUniforms(model, objectColor));
 
+    auto drawFrame = [&]() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(shaderProgram);
 
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        if (instanceBuffer) {
+            orbitAngle += 0.005f;
+            view = orbitView(orbitAngle, gridExtent * 0.9f, gridExtent * 0.3f);
+        }
 
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightDir"), 1, glm::value_ptr(lightDir));
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
-        glUniform3fv(glGetUniformLocation(shaderProgram, "objectColor"), 1, glm::value_ptr(objectColor));
+        frameData.update(makeFrameUniforms(view, projection, lightDir, lightColor));
+        frameData.flush();
+        objectData.flush();
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        if (instanceBuffer) {
+            size_t visible = instanceBuffer->upload(instances, instanceBounds, extractFrustum(projection * view));
+            instanceBuffer->draw(36, visible);
+        } else if (mesh.vao) {
+            drawMesh(mesh);
+        } else {
+            glBindVertexArray(VAO);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glBindVertexArray(0);
+        }
+    };
 
-        window.display();
+    int exitCode = 0;
+    if (offscreen.frames > 0) {
+        // Same frames as the window would show with no keys pressed
+        if (!renderOffscreen(context->loader(), offscreen.width, offscreen.height, offscreen, [&](unsigned) { drawFrame(); })) exitCode = 1;
+    } else {
+        sf::Window& window = *context->window();
+        FrameProfiler profiler(context->loader());
+        if (!profileCsvPath.empty()) profiler.openCsv(profileCsvPath);
+
+        bool running = true;
+        while (running) {
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                if (event.type == sf::Event::Closed) {
+                    running = false;
+                }
+            }
+
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) lightDir.y += 0.1f;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) lightDir.y -= 0.1f;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) lightDir.x -= 0.1f;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) lightDir.x += 0.1f;
+
+            profiler.beginFrame();
+            drawFrame();
+            profiler.endFrame();
+
+            window.display();
+        }
+
+        profiler.report(std::cout);
     }
 
+    std::cout << "FrameData uploads: " << frameData.uploadCount()
+              << ", ObjectData uploads: " << objectData.uploadCount() << std::endl;
+
+    instanceBuffer.reset();
+    if (mesh.vao) deleteMesh(mesh);
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteProgram(shaderProgram);
 
-    window.close();
-    return 0;
+    return exitCode;
 }
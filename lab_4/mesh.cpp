@@ -0,0 +1,470 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t meshFileVersion = 1;
+
+// One face corner of an OBJ file, zero-based. Without a normal index
+// hasNormal is false and normal is -1.
+struct ObjCorner {
+    int position;
+    int normal;
+    bool hasNormal;
+};
+
+// OBJ indices are 1-based, negative values count back from the last element
+int resolveObjIndex(long index, size_t count) {
+    return index > 0 ? static_cast<int>(index - 1) : static_cast<int>(count) + static_cast<int>(index);
+}
+
+// strtol skips leading whitespace, which would read the next corner of the
+// face as the index of an empty field ("1/2/ 3")
+bool startsIndex(const char* cursor) {
+    return std::isdigit(static_cast<unsigned char>(*cursor)) || *cursor == '-' || *cursor == '+';
+}
+
+// Parses "v", "v/vt", "v//vn" or "v/vt/vn" and advances cursor past it
+bool parseCorner(const char*& cursor, size_t positionCount, size_t normalCount, ObjCorner& corner) {
+    char* end = nullptr;
+    long position = std::strtol(cursor, &end, 10);
+    if (end == cursor) return false;
+    cursor = end;
+
+    corner.position = resolveObjIndex(position, positionCount);
+    corner.normal = -1;
+    corner.hasNormal = false;
+
+    if (*cursor == '/') {
+        ++cursor;
+        if (startsIndex(cursor)) {
+            std::strtol(cursor, &end, 10); // texture coordinate, unused
+            cursor = end;
+        }
+        if (*cursor == '/') {
+            ++cursor;
+            if (startsIndex(cursor)) {
+                long normal = std::strtol(cursor, &end, 10);
+                if (end == cursor) return false;
+                cursor = end;
+                corner.normal = resolveObjIndex(normal, normalCount);
+                corner.hasNormal = true;
+            }
+        }
+    }
+    if (corner.position < 0 || corner.position >= static_cast<int>(positionCount)) return false;
+    // A normal index that was given must exist; only an absent one is generated
+    return !corner.hasNormal || (corner.normal >= 0 && corner.normal < static_cast<int>(normalCount));
+}
+
+void faceNormal(const float* a, const float* b, const float* c, float* normal) {
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+void normalize(float* v) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 1e-12f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+// Forsyth vertex scoring, see "Linear-Speed Vertex Cache Optimisation"
+const int forsythCacheSize = 32;
+const int forsythMaxValence = 32;
+
+struct ForsythScores {
+    float cache[forsythCacheSize];
+    float valence[forsythMaxValence];
+
+    ForsythScores() {
+        const float lastTriangleScore = 0.75f;
+        const float cacheDecayPower = 1.5f;
+        const float valenceBoostScale = 2.0f;
+        const float valenceBoostPower = 0.5f;
+
+        for (int i = 0; i < forsythCacheSize; ++i) {
+            // The three most recent vertices belong to the last triangle; penalise
+            // them slightly so strips don't double back on themselves
+            cache[i] = i < 3 ? lastTriangleScore
+                             : std::pow(1.0f - (i - 3) / static_cast<float>(forsythCacheSize - 3), cacheDecayPower);
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i < forsythMaxValence; ++i) {
+            valence[i] = valenceBoostScale * std::pow(static_cast<float>(i), -valenceBoostPower);
+        }
+    }
+
+    float score(int cachePosition, uint32_t remainingTriangles) const {
+        if (remainingTriangles == 0) return -1.0f;
+        float result = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+        result += remainingTriangles < static_cast<uint32_t>(forsythMaxValence)
+                      ? valence[remainingTriangles]
+                      : 2.0f * std::pow(static_cast<float>(remainingTriangles), -0.5f);
+        return result;
+    }
+};
+
+void optimizeTriangleOrder(std::vector<uint32_t>& indices, size_t vertexCount) {
+    static const ForsythScores scores;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // Triangles adjacent to each vertex (CSR); the first remaining[v] entries of
+    // each range are the triangles not emitted yet
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices) ++remaining[index];
+
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+    }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) vertexScore[v] = scores.score(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(forsythCacheSize + 3);
+    nextCache.reserve(forsythCacheSize + 3);
+
+    long bestTriangle = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+    size_t scanCursor = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (bestTriangle < 0) {
+            // Nothing in the cache has triangles left: continue with the next unused one
+            while (emitted[scanCursor]) ++scanCursor;
+            bestTriangle = static_cast<long>(scanCursor);
+        }
+
+        const uint32_t* triangle = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = 1;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = triangle[k];
+            uint32_t* begin = &adjacency[adjacencyOffset[v]];
+            uint32_t* end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, static_cast<uint32_t>(bestTriangle)), end - 1);
+            --remaining[v];
+        }
+
+        // LRU update: the emitted triangle moves to the front
+        nextCache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) nextCache.push_back(v);
+        }
+        // Evicted vertices lose their cache bonus, and so do their triangles
+        for (size_t i = forsythCacheSize; i < nextCache.size(); ++i) {
+            uint32_t v = nextCache[i];
+            vertexScore[v] = scores.score(-1, remaining[v]);
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                uint32_t t = adjacency[adjacencyOffset[v] + j];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+            }
+        }
+        if (nextCache.size() > static_cast<size_t>(forsythCacheSize)) nextCache.resize(forsythCacheSize);
+        cache.swap(nextCache);
+
+        for (size_t i = 0; i < cache.size(); ++i) {
+            vertexScore[cache[i]] = scores.score(static_cast<int>(i), remaining[cache[i]]);
+        }
+
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                uint32_t t = adjacency[adjacencyOffset[v] + j];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+// Renumbers vertices in order of first use so vertex fetch walks memory forwards
+void optimizeVertexOrder(Mesh& mesh) {
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+size_t alignTo16(size_t offset) {
+    return (offset + 15) & ~static_cast<size_t>(15);
+}
+
+} // namespace
+
+bool loadObj(const std::string& path, Mesh& mesh, bool deduplicate) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "ERROR::MESH::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<ObjCorner> corners; // three per triangle
+    std::vector<ObjCorner> polygon;
+    bool missingNormals = false;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        const char* cursor = line.c_str();
+        while (*cursor == ' ' || *cursor == '\t') ++cursor;
+
+        if (cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+            char* end = nullptr;
+            ++cursor;
+            for (int i = 0; i < 3; ++i) {
+                positions.push_back(std::strtof(cursor, &end));
+                cursor = end;
+            }
+        } else if (cursor[0] == 'v' && cursor[1] == 'n') {
+            char* end = nullptr;
+            cursor += 2;
+            for (int i = 0; i < 3; ++i) {
+                normals.push_back(std::strtof(cursor, &end));
+                cursor = end;
+            }
+        } else if (cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+            ++cursor;
+            polygon.clear();
+            ObjCorner corner;
+            while (true) {
+                while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r') ++cursor;
+                if (*cursor == '\0') break;
+                if (!parseCorner(cursor, positions.size() / 3, normals.size() / 3, corner)) {
+                    std::cerr << "ERROR::MESH::BAD_FACE " << path << ": " << line << std::endl;
+                    return false;
+                }
+                missingNormals |= !corner.hasNormal;
+                polygon.push_back(corner);
+            }
+            for (size_t i = 2; i < polygon.size(); ++i) {
+                corners.push_back(polygon[0]);
+                corners.push_back(polygon[i - 1]);
+                corners.push_back(polygon[i]);
+            }
+        }
+    }
+
+    // Smooth normals for corners without one: area-weighted sum of face normals
+    std::vector<float> generatedNormals;
+    if (missingNormals) {
+        generatedNormals.assign(positions.size(), 0.0f);
+        for (size_t i = 0; i < corners.size(); i += 3) {
+            float normal[3];
+            faceNormal(&positions[corners[i].position * 3], &positions[corners[i + 1].position * 3],
+                       &positions[corners[i + 2].position * 3], normal);
+            for (int k = 0; k < 3; ++k) {
+                float* target = &generatedNormals[corners[i + k].position * 3];
+                target[0] += normal[0];
+                target[1] += normal[1];
+                target[2] += normal[2];
+            }
+        }
+        for (size_t i = 0; i < generatedNormals.size(); i += 3) normalize(&generatedNormals[i]);
+    }
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.indices.reserve(corners.size());
+
+    std::unordered_map<uint64_t, uint32_t> unique;
+    if (deduplicate) unique.reserve(corners.size());
+
+    for (const ObjCorner& corner : corners) {
+        if (deduplicate) {
+            uint64_t key = (static_cast<uint64_t>(corner.position) << 32) | static_cast<uint32_t>(corner.normal + 1);
+            auto inserted = unique.emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+            if (!inserted.second) {
+                mesh.indices.push_back(inserted.first->second);
+                continue;
+            }
+        }
+
+        MeshVertex vertex;
+        const float* normal = corner.hasNormal ? &normals[corner.normal * 3] : &generatedNormals[corner.position * 3];
+        std::memcpy(vertex.position, &positions[corner.position * 3], sizeof(vertex.position));
+        std::memcpy(vertex.normal, normal, sizeof(vertex.normal));
+
+        mesh.indices.push_back(static_cast<uint32_t>(mesh.vertices.size()));
+        mesh.vertices.push_back(vertex);
+    }
+    return true;
+}
+
+void computeBounds(const Mesh& mesh, float boundsMin[3], float boundsMax[3]) {
+    for (int k = 0; k < 3; ++k) {
+        boundsMin[k] = mesh.vertices.empty() ? 0.0f : mesh.vertices[0].position[k];
+        boundsMax[k] = boundsMin[k];
+    }
+    for (const MeshVertex& vertex : mesh.vertices) {
+        for (int k = 0; k < 3; ++k) {
+            boundsMin[k] = std::min(boundsMin[k], vertex.position[k]);
+            boundsMax[k] = std::max(boundsMax[k], vertex.position[k]);
+        }
+    }
+}
+
+void optimizeMesh(Mesh& mesh) {
+    optimizeTriangleOrder(mesh.indices, mesh.vertices.size());
+    optimizeVertexOrder(mesh);
+}
+
+float computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize) {
+    if (indices.size() < 3) return 0.0f;
+
+    // FIFO: a vertex stays cached until cacheSize newer vertices have been loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    uint32_t clock = static_cast<uint32_t>(cacheSize) + 1;
+    size_t misses = 0;
+
+    for (uint32_t index : indices) {
+        if (clock - loadedAt[index] > static_cast<uint32_t>(cacheSize)) {
+            loadedAt[index] = clock++;
+            ++misses;
+        }
+    }
+    return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+bool writeMeshFile(const std::string& path, const Mesh& mesh) {
+    MeshFileHeader header = {};
+    std::memcpy(header.magic, "L4MS", 4);
+    header.version = meshFileVersion;
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.indexSize = mesh.vertices.size() < 65536 ? 2 : 4;
+    header.vertexOffset = static_cast<uint32_t>(alignTo16(sizeof(MeshFileHeader)));
+    header.indexOffset = static_cast<uint32_t>(alignTo16(header.vertexOffset + mesh.vertices.size() * sizeof(MeshVertex)));
+    computeBounds(mesh, header.boundsMin, header.boundsMax);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR::MESH::CANNOT_WRITE " << path << std::endl;
+        return false;
+    }
+
+    const char padding[16] = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padding, header.vertexOffset - sizeof(header));
+    file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(MeshVertex));
+    file.write(padding, header.indexOffset - (header.vertexOffset + mesh.vertices.size() * sizeof(MeshVertex)));
+
+    if (header.indexSize == 2) {
+        std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+        file.write(reinterpret_cast<const char*>(shortIndices.data()), shortIndices.size() * sizeof(uint16_t));
+    } else {
+        file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+    }
+    return static_cast<bool>(file);
+}
+
+MappedMesh::~MappedMesh() {
+    close();
+}
+
+bool MappedMesh::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file) {
+        fallback.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(fallback.data(), fallback.size());
+        data = fallback.data();
+        size = fallback.size();
+    }
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor >= 0) {
+        struct stat info;
+        if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+            void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapping != MAP_FAILED) {
+                data = static_cast<const char*>(mapping);
+                size = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(descriptor);
+    }
+#endif
+
+    if (!data) {
+        std::cerr << "ERROR::MESH::CANNOT_OPEN " << path << std::endl;
+        return false;
+    }
+
+    bool valid = size >= sizeof(MeshFileHeader) &&
+                 std::memcmp(header().magic, "L4MS", 4) == 0 &&
+                 header().version == meshFileVersion &&
+                 (header().indexSize == 2 || header().indexSize == 4) &&
+                 header().vertexOffset + vertexBytes() <= size &&
+                 header().indexOffset + indexBytes() <= size;
+    if (!valid) {
+        std::cerr << "ERROR::MESH::BAD_FILE " << path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedMesh::close() {
+#ifdef _WIN32
+    fallback.clear();
+#else
+    if (data) munmap(const_cast<char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
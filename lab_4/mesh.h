@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Same layout as the cube vertices in lab_4.cpp: position followed by normal
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+};
+
+struct Mesh {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices; // triangle list
+};
+
+// Reads positions, normals and faces (polygons are fan-triangulated) from an
+// OBJ file. With deduplicate set, identical position/normal pairs share one
+// vertex and the index buffer references them; otherwise every face corner
+// becomes its own vertex, like the hardcoded cube. Missing normals are
+// generated by averaging the adjacent face normals.
+bool loadObj(const std::string& path, Mesh& mesh, bool deduplicate = true);
+
+// Axis-aligned bounds of the vertex positions
+void computeBounds(const Mesh& mesh, float boundsMin[3], float boundsMax[3]);
+
+// Reorders triangles for the post-transform vertex cache (Forsyth's linear-speed
+// algorithm), then reorders vertices by first use so fetches stay sequential.
+void optimizeMesh(Mesh& mesh);
+
+// Average cache miss ratio: transformed vertices per triangle for a FIFO
+// post-transform cache of cacheSize entries. 3.0 means no reuse at all;
+// well-ordered closed meshes approach 0.5-0.7.
+float computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
+
+// Binary mesh file: a fixed header followed by the vertex and index arrays,
+// both 16-byte aligned and stored exactly as glBufferData expects them.
+// Indices are 16-bit when the mesh has fewer than 65536 vertices.
+struct MeshFileHeader {
+    char magic[4];          // "L4MS"
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;     // 2 or 4 bytes
+    uint32_t vertexOffset;  // from the start of the file
+    uint32_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+bool writeMeshFile(const std::string& path, const Mesh& mesh);
+
+// Read-only memory mapping of a mesh file. Nothing is parsed or copied: the
+// vertex and index pointers point straight into the mapping.
+class MappedMesh {
+public:
+    MappedMesh() = default;
+    ~MappedMesh();
+    MappedMesh(const MappedMesh&) = delete;
+    MappedMesh& operator=(const MappedMesh&) = delete;
+
+    bool open(const std::string& path);
+
+    const MeshFileHeader& header() const { return *reinterpret_cast<const MeshFileHeader*>(data); }
+    const void* vertexData() const { return data + header().vertexOffset; }
+    const void* indexData() const { return data + header().indexOffset; }
+    size_t vertexBytes() const { return static_cast<size_t>(header().vertexCount) * sizeof(MeshVertex); }
+    size_t indexBytes() const { return static_cast<size_t>(header().indexCount) * header().indexSize; }
+
+private:
+    void close();
+
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    std::vector<char> fallback;
+#endif
+};
@@ -0,0 +1,495 @@
+#include "software_rasterizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTWARE_RASTERIZER_SSE2 1
+#endif
+
+namespace {
+
+// Four floats processed together. Comparisons return a 4-bit lane mask.
+// ScalarFloat4 is always available; SimdFloat4 is SSE2 where the compiler
+// targets it and otherwise the same scalar code.
+struct ScalarFloat4 {
+    float v[4];
+
+    ScalarFloat4() = default;
+    explicit ScalarFloat4(float value) : v{ value, value, value, value } {}
+    ScalarFloat4(float a, float b, float c, float d) : v{ a, b, c, d } {}
+
+    static ScalarFloat4 load(const float* p) { return ScalarFloat4(p[0], p[1], p[2], p[3]); }
+    void store(float* p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+};
+
+#define FLOAT4_BINARY(name, expression) \
+    inline ScalarFloat4 name(ScalarFloat4 a, ScalarFloat4 b) { ScalarFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = expression; return r; }
+FLOAT4_BINARY(operator+, a.v[i] + b.v[i])
+FLOAT4_BINARY(operator-, a.v[i] - b.v[i])
+FLOAT4_BINARY(operator*, a.v[i] * b.v[i])
+FLOAT4_BINARY(operator/, a.v[i] / b.v[i])
+FLOAT4_BINARY(max, std::max(a.v[i], b.v[i]))
+#undef FLOAT4_BINARY
+
+inline ScalarFloat4 sqrt(ScalarFloat4 a) { ScalarFloat4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+#define FLOAT4_COMPARE(name, op) \
+    inline int name(ScalarFloat4 a, ScalarFloat4 b) { int m = 0; for (int i = 0; i < 4; ++i) m |= (a.v[i] op b.v[i]) << i; return m; }
+FLOAT4_COMPARE(greater, >)
+FLOAT4_COMPARE(greaterEqual, >=)
+FLOAT4_COMPARE(less, <)
+#undef FLOAT4_COMPARE
+
+#ifdef SOFTWARE_RASTERIZER_SSE2
+struct SimdFloat4 {
+    __m128 v;
+
+    SimdFloat4() = default;
+    SimdFloat4(__m128 value) : v(value) {}
+    explicit SimdFloat4(float value) : v(_mm_set1_ps(value)) {}
+    SimdFloat4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+    static SimdFloat4 load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline SimdFloat4 operator+(SimdFloat4 a, SimdFloat4 b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat4 operator-(SimdFloat4 a, SimdFloat4 b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat4 operator*(SimdFloat4 a, SimdFloat4 b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat4 operator/(SimdFloat4 a, SimdFloat4 b) { return _mm_div_ps(a.v, b.v); }
+inline SimdFloat4 max(SimdFloat4 a, SimdFloat4 b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat4 sqrt(SimdFloat4 a) { return _mm_sqrt_ps(a.v); }
+inline int greater(SimdFloat4 a, SimdFloat4 b) { return _mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v)); }
+inline int greaterEqual(SimdFloat4 a, SimdFloat4 b) { return _mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)); }
+inline int less(SimdFloat4 a, SimdFloat4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+#else
+typedef ScalarFloat4 SimdFloat4;
+#endif
+
+// Float to unorm8 the way GL converts fragment colors
+inline unsigned char toUnorm8(float value) {
+    return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static_assert(SoftwareRasterizer::tileSize % 4 == 0, "4-pixel groups must not cross tiles");
+
+const size_t verticesPerTask = 4096;
+const size_t trianglesPerChunk = 4096;
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Worker pool
+// ---------------------------------------------------------------------------
+
+// Fixed set of threads that run(count, job) puts to work on job(0..count-1).
+// The calling thread takes tasks too, so a pool of one thread is just a loop.
+class SoftwareRasterizer::WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads) {
+        for (unsigned i = 1; i < threads; ++i) workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    void run(size_t count, const std::function<void(size_t)>& job) {
+        if (count == 0) return;
+        if (workers.empty() || count == 1) {
+            for (size_t i = 0; i < count; ++i) job(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentJob = &job;
+            taskCount = count;
+            nextTask = 0;
+            busyWorkers = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        work(job, count);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busyWorkers == 0; });
+        currentJob = nullptr;
+    }
+
+private:
+    void work(const std::function<void(size_t)>& job, size_t count) {
+        for (size_t task = nextTask++; task < count; task = nextTask++) job(task);
+    }
+
+    void workerLoop() {
+        size_t seenGeneration = 0;
+        for (;;) {
+            const std::function<void(size_t)>* job;
+            size_t count;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) return;
+                seenGeneration = generation;
+                job = currentJob;
+                count = taskCount;
+            }
+
+            work(*job, count);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --busyWorkers;
+            }
+            done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* currentJob = nullptr;
+    size_t taskCount = 0;
+    std::atomic<size_t> nextTask{ 0 };
+    size_t busyWorkers = 0;
+    size_t generation = 0;
+    bool stopping = false;
+};
+
+// ---------------------------------------------------------------------------
+// Pipeline data
+// ---------------------------------------------------------------------------
+
+// Output of the vertex stage: gl_Position and Normal. FragPos isn't used by
+// the fragment shader, so it isn't computed.
+struct SoftwareRasterizer::TransformedVertex {
+    glm::vec4 clip;
+    glm::vec3 normal;
+};
+
+// Screen-space triangle ready for rasterization. Edge i is opposite vertex i,
+// so its value at a pixel is that vertex's barycentric weight times twice the
+// area.
+struct SoftwareRasterizer::Triangle {
+    float originX[3], originY[3]; // a point on each edge
+    float edgeA[3], edgeB[3];     // E(p) = A * (px - ox) + B * (py - oy)
+    bool topLeft[3];              // pixels exactly on the edge belong to this triangle
+    float inverseArea;
+    float z[3];                   // window depth
+    glm::vec3 normal[3];          // normal divided by w, for perspective-correct interpolation
+    int minX, minY, maxX, maxY;   // pixels whose centers may be covered
+};
+
+struct SoftwareRasterizer::TriangleChunk {
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> bins; // triangle indices per tile
+};
+
+// ---------------------------------------------------------------------------
+// SoftwareRasterizer
+// ---------------------------------------------------------------------------
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, unsigned threadCount, bool simd)
+    : targetWidth(width), targetHeight(height), useSimd(simd), depthStride((width + 3) & ~3),
+      tilesX((width + tileSize - 1) / tileSize), tilesY((height + tileSize - 1) / tileSize),
+      color(static_cast<size_t>(width) * height * 4), depth(static_cast<size_t>(depthStride) * height) {
+    if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    pool.reset(new WorkerPool(threadCount));
+    clear();
+}
+
+SoftwareRasterizer::~SoftwareRasterizer() = default;
+
+unsigned SoftwareRasterizer::threadCount() const {
+    return pool->size();
+}
+
+void SoftwareRasterizer::clear() {
+    std::fill(color.begin(), color.end(), 0);
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareRasterizer::draw(const MeshVertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+                              const SoftwareUniforms& uniforms) {
+    // Vertex stage, as in vertexShaderSource; the normal matrix is computed
+    // the same way as makeObjectUniforms does
+    const glm::mat4 viewProjection = uniforms.projection * uniforms.view;
+    const glm::mat4 modelViewProjection = viewProjection * uniforms.model;
+    const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(uniforms.model)));
+
+    transformed.resize(vertexCount);
+    pool->run((vertexCount + verticesPerTask - 1) / verticesPerTask, [&](size_t task) {
+        size_t end = std::min(vertexCount, (task + 1) * verticesPerTask);
+        for (size_t i = task * verticesPerTask; i < end; ++i) {
+            const MeshVertex& vertex = vertices[i];
+            transformed[i].clip = modelViewProjection * glm::vec4(vertex.position[0], vertex.position[1], vertex.position[2], 1.0f);
+            transformed[i].normal = normalMatrix * glm::vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+        }
+    });
+
+    // Setup and binning, one chunk of triangles per task
+    size_t triangleCount = (indices ? indexCount : vertexCount) / 3;
+    chunksUsed = (triangleCount + trianglesPerChunk - 1) / trianglesPerChunk;
+    if (chunks.size() < chunksUsed) chunks.resize(chunksUsed);
+
+    pool->run(chunksUsed, [&](size_t task) {
+        TriangleChunk& chunk = chunks[task];
+        chunk.triangles.clear();
+        chunk.bins.resize(tilesX * tilesY);
+        for (std::vector<uint32_t>& bin : chunk.bins) bin.clear();
+
+        size_t end = std::min(triangleCount, (task + 1) * trianglesPerChunk);
+        for (size_t t = task * trianglesPerChunk; t < end; ++t) {
+            const TransformedVertex* corners[3];
+            for (int k = 0; k < 3; ++k) {
+                size_t index = indices ? indices[t * 3 + k] : t * 3 + k;
+                corners[k] = &transformed[index];
+            }
+            setupTriangle(corners, chunk);
+        }
+    });
+
+    // Rasterization, one tile per task
+    pool->run(static_cast<size_t>(tilesX) * tilesY, [&](size_t tile) {
+        rasterizeTile(static_cast<int>(tile), uniforms);
+    });
+}
+
+// Clips against the near plane (z >= -w), which can turn the triangle into a
+// quad, then sets up and bins each resulting triangle. The other planes need
+// no clipping: coverage is limited to the screen and depth is tested per pixel.
+void SoftwareRasterizer::setupTriangle(const TransformedVertex* corners[3], TriangleChunk& chunk) {
+    TransformedVertex polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        const TransformedVertex& a = *corners[i];
+        const TransformedVertex& b = *corners[(i + 1) % 3];
+        float distanceA = a.clip.z + a.clip.w;
+        float distanceB = b.clip.z + b.clip.w;
+        if (distanceA >= 0.0f) polygon[count++] = a;
+        if ((distanceA >= 0.0f) != (distanceB >= 0.0f)) {
+            float t = distanceA / (distanceA - distanceB);
+            polygon[count].clip = a.clip + (b.clip - a.clip) * t;
+            polygon[count].normal = a.normal + (b.normal - a.normal) * t;
+            ++count;
+        }
+    }
+
+    for (int fan = 1; fan + 1 < count; ++fan) {
+        const TransformedVertex* vertex[3] = { &polygon[0], &polygon[fan], &polygon[fan + 1] };
+
+        Triangle triangle;
+        float x[3], y[3];
+        for (int i = 0; i < 3; ++i) {
+            float inverseW = 1.0f / vertex[i]->clip.w;
+            // Snap to 1/256 pixel like GL implementations (GL_SUBPIXEL_BITS 8),
+            // so shared edges and silhouettes land on the same pixels
+            x[i] = std::round((vertex[i]->clip.x * inverseW * 0.5f + 0.5f) * targetWidth * 256.0f) / 256.0f;
+            y[i] = std::round((vertex[i]->clip.y * inverseW * 0.5f + 0.5f) * targetHeight * 256.0f) / 256.0f;
+            triangle.z[i] = vertex[i]->clip.z * inverseW * 0.5f + 0.5f;
+            triangle.normal[i] = vertex[i]->normal * inverseW;
+        }
+
+        // Twice the signed area; GL_CULL_FACE is off, so both windings are
+        // drawn and clockwise ones are flipped
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f || !std::isfinite(area)) continue;
+        if (area < 0.0f) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(triangle.z[1], triangle.z[2]);
+            std::swap(triangle.normal[1], triangle.normal[2]);
+            area = -area;
+        }
+        triangle.inverseArea = 1.0f / area;
+
+        for (int i = 0; i < 3; ++i) {
+            int a = (i + 1) % 3;
+            int b = (i + 2) % 3;
+            triangle.originX[i] = x[a];
+            triangle.originY[i] = y[a];
+            triangle.edgeA[i] = y[a] - y[b];
+            triangle.edgeB[i] = x[b] - x[a];
+            // Counter-clockwise with y up: left edges go down, top edges go left
+            triangle.topLeft[i] = y[b] < y[a] || (y[b] == y[a] && x[b] < x[a]);
+        }
+
+        float minX = std::min(x[0], std::min(x[1], x[2]));
+        float maxX = std::max(x[0], std::max(x[1], x[2]));
+        float minY = std::min(y[0], std::min(y[1], y[2]));
+        float maxY = std::max(y[0], std::max(y[1], y[2]));
+        triangle.minX = std::max(0, static_cast<int>(std::ceil(std::max(minX, -1.0f) - 0.5f)));
+        triangle.minY = std::max(0, static_cast<int>(std::ceil(std::max(minY, -1.0f) - 0.5f)));
+        triangle.maxX = std::min(targetWidth - 1, static_cast<int>(std::floor(std::min(maxX, targetWidth + 1.0f) - 0.5f)));
+        triangle.maxY = std::min(targetHeight - 1, static_cast<int>(std::floor(std::min(maxY, targetHeight + 1.0f) - 0.5f)));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) continue;
+
+        uint32_t index = static_cast<uint32_t>(chunk.triangles.size());
+        chunk.triangles.push_back(triangle);
+        for (int tileY = triangle.minY / tileSize; tileY <= triangle.maxY / tileSize; ++tileY) {
+            for (int tileX = triangle.minX / tileSize; tileX <= triangle.maxX / tileSize; ++tileX) {
+                chunk.bins[tileY * tilesX + tileX].push_back(index);
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile, const SoftwareUniforms& uniforms) {
+    int tileX0 = (tile % tilesX) * tileSize;
+    int tileY0 = (tile / tilesX) * tileSize;
+    int tileX1 = std::min(tileX0 + tileSize, targetWidth) - 1;
+    int tileY1 = std::min(tileY0 + tileSize, targetHeight) - 1;
+    glm::vec3 light = glm::normalize(-uniforms.lightDir);
+
+    for (size_t c = 0; c < chunksUsed; ++c) {
+        const TriangleChunk& chunk = chunks[c];
+        for (uint32_t index : chunk.bins[tile]) {
+            if (useSimd) {
+                rasterizeTriangle<SimdFloat4>(chunk.triangles[index], tileX0, tileY0, tileX1, tileY1, light, uniforms);
+            } else {
+                rasterizeTriangle<ScalarFloat4>(chunk.triangles[index], tileX0, tileY0, tileX1, tileY1, light, uniforms);
+            }
+        }
+    }
+}
+
+// Pixels are processed in groups of 4 starting at multiples of 4. Tiles start
+// at multiples of 4 too (tileSize is one), so a group never reaches into a
+// neighbouring tile, which another worker may be writing, and depthStride
+// padding keeps the last group of a row inside the depth buffer.
+template <typename Float4>
+void SoftwareRasterizer::rasterizeTriangle(const Triangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1,
+                                           const glm::vec3& light, const SoftwareUniforms& uniforms) {
+    int x0 = std::max(triangle.minX, tileX0);
+    int x1 = std::min(triangle.maxX, tileX1);
+    int y0 = std::max(triangle.minY, tileY0);
+    int y1 = std::min(triangle.maxY, tileY1);
+    if (x0 > x1 || y0 > y1) return;
+
+    // fragmentShaderSource with the constant parts folded:
+    // color = (ambient + diff * lightColor) * objectColor
+    const glm::vec3 ambient = 0.2f * uniforms.lightColor * uniforms.objectColor;
+    const glm::vec3 diffuse = uniforms.lightColor * uniforms.objectColor;
+
+    const Float4 zero(0.0f);
+    const Float4 inverseArea(triangle.inverseArea);
+    const Float4 laneOffsets(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (int py = y0; py <= y1; ++py) {
+        float* depthRow = depth.data() + static_cast<size_t>(py) * depthStride;
+        unsigned char* colorRow = color.data() + static_cast<size_t>(py) * targetWidth * 4;
+        float centerY = py + 0.5f;
+
+        for (int px = x0 & ~3; px <= x1; px += 4) {
+            Float4 centerX = Float4(static_cast<float>(px)) + laneOffsets;
+
+            // Lanes outside [x0, x1], then edge functions; pixels exactly on
+            // an edge count only for top-left edges
+            Float4 edge[3];
+            int mask = 0xF;
+            if (px < x0) mask &= 0xF << (x0 - px);
+            if (x1 - px < 3) mask &= (1 << (x1 - px + 1)) - 1;
+            for (int i = 0; i < 3 && mask; ++i) {
+                edge[i] = Float4(triangle.edgeA[i]) * (centerX - Float4(triangle.originX[i])) +
+                          Float4(triangle.edgeB[i] * (centerY - triangle.originY[i]));
+                mask &= triangle.topLeft[i] ? greaterEqual(edge[i], zero) : greater(edge[i], zero);
+            }
+            if (!mask) continue;
+
+            // Early depth: shade only what passes GL_LESS
+            Float4 weight0 = edge[0] * inverseArea;
+            Float4 weight1 = edge[1] * inverseArea;
+            Float4 weight2 = edge[2] * inverseArea;
+            Float4 z = weight0 * Float4(triangle.z[0]) + weight1 * Float4(triangle.z[1]) + weight2 * Float4(triangle.z[2]);
+            mask &= less(z, Float4::load(depthRow + px));
+            if (!mask) continue;
+
+            // Perspective-correct normal; the 1/w normalization cancels out
+            // in normalize(Normal)
+            Float4 nx = weight0 * Float4(triangle.normal[0].x) + weight1 * Float4(triangle.normal[1].x) + weight2 * Float4(triangle.normal[2].x);
+            Float4 ny = weight0 * Float4(triangle.normal[0].y) + weight1 * Float4(triangle.normal[1].y) + weight2 * Float4(triangle.normal[2].y);
+            Float4 nz = weight0 * Float4(triangle.normal[0].z) + weight1 * Float4(triangle.normal[1].z) + weight2 * Float4(triangle.normal[2].z);
+            Float4 length = sqrt(nx * nx + ny * ny + nz * nz);
+            Float4 diff = max((nx * Float4(light.x) + ny * Float4(light.y) + nz * Float4(light.z)) / length, zero);
+
+            Float4 red = Float4(ambient.x) + diff * Float4(diffuse.x);
+            Float4 green = Float4(ambient.y) + diff * Float4(diffuse.y);
+            Float4 blue = Float4(ambient.z) + diff * Float4(diffuse.z);
+
+            float zLanes[4], redLanes[4], greenLanes[4], blueLanes[4];
+            z.store(zLanes);
+            red.store(redLanes);
+            green.store(greenLanes);
+            blue.store(blueLanes);
+            for (int lane = 0; lane < 4; ++lane) {
+                if (!(mask & (1 << lane))) continue;
+                depthRow[px + lane] = zLanes[lane];
+                unsigned char* pixel = colorRow + static_cast<size_t>(px + lane) * 4;
+                pixel[0] = toUnorm8(redLanes[lane]);
+                pixel[1] = toUnorm8(greenLanes[lane]);
+                pixel[2] = toUnorm8(blueLanes[lane]);
+                pixel[3] = 255;
+            }
+        }
+    }
+}
+
+Mesh createSubdividedCube(int divisions) {
+    divisions = std::max(1, divisions);
+    Mesh mesh;
+
+    // Normal, then the two in-plane axes chosen so that u x v = normal
+    const float faces[6][9] = {
+        {  0,  0,  1,   1,  0,  0,   0,  1,  0 },
+        {  0,  0, -1,  -1,  0,  0,   0,  1,  0 },
+        { -1,  0,  0,   0,  0,  1,   0,  1,  0 },
+        {  1,  0,  0,   0,  0, -1,   0,  1,  0 },
+        {  0,  1,  0,   1,  0,  0,   0,  0, -1 },
+        {  0, -1,  0,   1,  0,  0,   0,  0,  1 },
+    };
+
+    size_t row = static_cast<size_t>(divisions) + 1;
+    mesh.vertices.reserve(6 * row * row);
+    mesh.indices.reserve(36 * static_cast<size_t>(divisions) * divisions);
+    for (const float* face : faces) {
+        uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+        for (int j = 0; j <= divisions; ++j) {
+            for (int i = 0; i <= divisions; ++i) {
+                float u = static_cast<float>(i) / divisions - 0.5f;
+                float v = static_cast<float>(j) / divisions - 0.5f;
+                MeshVertex vertex;
+                for (int k = 0; k < 3; ++k) {
+                    vertex.position[k] = face[k] * 0.5f + face[3 + k] * u + face[6 + k] * v;
+                    vertex.normal[k] = face[k];
+                }
+                mesh.vertices.push_back(vertex);
+            }
+        }
+        for (int j = 0; j < divisions; ++j) {
+            for (int i = 0; i < divisions; ++i) {
+                uint32_t a = base + static_cast<uint32_t>(j * row + i);
+                uint32_t b = a + 1;
+                uint32_t c = a + static_cast<uint32_t>(row);
+                uint32_t d = c + 1;
+                mesh.indices.insert(mesh.indices.end(), { a, b, d, a, d, c });
+            }
+        }
+    }
+    return mesh;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Inputs of the lighting shaders: the FrameData and ObjectData blocks
+struct SoftwareUniforms {
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 lightDir;
+    glm::vec3 lightColor;
+    glm::vec3 objectColor;
+};
+
+// CPU implementation of vertexShaderSource + fragmentShaderSource, for hosts
+// without a usable GPU.
+//
+// Each draw runs in three parallel passes:
+//   1. vertex transform, in chunks of vertices;
+//   2. triangle setup (near-plane clipping, viewport transform, edge
+//      functions) and binning into 64x64 screen tiles. Every chunk of
+//      triangles has its own bins, so no locking is needed and walking the
+//      chunks in order keeps primitives in submission order;
+//   3. rasterization, one tile per task. Edge functions, early depth test and
+//      shading work on 4 pixels at a time (SSE2 where available).
+// Rasterization follows GL rules closely enough that images match the GL
+// path up to a few edge pixels and rounding: pixel centers at +0.5, top-left
+// fill rule, GL_LESS depth test, perspective-correct normals.
+class SoftwareRasterizer {
+public:
+    static const int tileSize = 64;  // must stay a multiple of 4, see rasterizeTriangle
+
+    // threadCount 0 uses every hardware thread. simd false forces the scalar
+    // 4-lane code even where SSE2 is available, as a reference for testing.
+    SoftwareRasterizer(int width, int height, unsigned threadCount = 0, bool simd = true);
+    ~SoftwareRasterizer();
+    SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+    // Color to (0, 0, 0, 0) and depth to 1, like glClear with default values
+    void clear();
+
+    // Triangle list. indices may be null to use vertices in order, like
+    // glDrawArrays.
+    void draw(const MeshVertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+              const SoftwareUniforms& uniforms);
+
+    // RGBA8, bottom row first, the same layout glReadPixels returns
+    const unsigned char* pixels() const { return color.data(); }
+    int width() const { return targetWidth; }
+    int height() const { return targetHeight; }
+    unsigned threadCount() const;
+
+private:
+    class WorkerPool;
+    struct TransformedVertex;
+    struct Triangle;
+    struct TriangleChunk;
+
+    void setupTriangle(const TransformedVertex* corners[3], TriangleChunk& chunk);
+    void rasterizeTile(int tile, const SoftwareUniforms& uniforms);
+    template <typename Float4>
+    void rasterizeTriangle(const Triangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1,
+                           const glm::vec3& light, const SoftwareUniforms& uniforms);
+
+    int targetWidth;
+    int targetHeight;
+    bool useSimd;
+    int depthStride;  // rounded up to 4 so rows can be loaded 4 floats at a time
+    int tilesX;
+    int tilesY;
+    std::vector<unsigned char> color;
+    std::vector<float> depth;
+
+    std::unique_ptr<WorkerPool> pool;
+    std::vector<TransformedVertex> transformed;
+    std::vector<TriangleChunk> chunks;
+    size_t chunksUsed = 0;
+};
+
+// Cube from -0.5 to 0.5 with every face split into divisions x divisions
+// quads: 12 * divisions^2 triangles, with the same per-face normals as the
+// cube in lab_4.cpp
+Mesh createSubdividedCube(int divisions);
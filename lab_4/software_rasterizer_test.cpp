@@ -0,0 +1,92 @@
+// Compares the SSE2 rasterizer with the scalar 4-lane code on triangles that
+// touch the right and bottom/top edges of the target, where 4-pixel groups
+// meet the end of a row and of the depth buffer. Run under ASan to catch
+// out-of-bounds depth loads.
+#include "software_rasterizer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Triangle in normalized device coordinates; the uniforms below are identity
+void addTriangle(Mesh& mesh, float x0, float y0, float x1, float y1, float x2, float y2, float z) {
+    const float corners[3][2] = { { x0, y0 }, { x1, y1 }, { x2, y2 } };
+    for (const float* corner : corners) {
+        MeshVertex vertex;
+        vertex.position[0] = corner[0];
+        vertex.position[1] = corner[1];
+        vertex.position[2] = z;
+        vertex.normal[0] = 0.0f;
+        vertex.normal[1] = 0.0f;
+        vertex.normal[2] = 1.0f;
+        mesh.indices.push_back(static_cast<uint32_t>(mesh.vertices.size()));
+        mesh.vertices.push_back(vertex);
+    }
+}
+
+Mesh createEdgeTriangles(int width) {
+    Mesh mesh;
+    float pixel = 2.0f / width;
+    // Right edge on the bottom row (first in memory) and beyond the screen
+    addTriangle(mesh, 0.5f, -1.2f, 1.2f, -1.2f, 1.2f, -0.5f, 0.0f);
+    // Right edge on the top row (last in memory): the last group of the
+    // depth buffer
+    addTriangle(mesh, 1.0f - 3.5f * pixel, 0.9f, 1.1f, 0.9f, 1.0f - 3.5f * pixel, 1.2f, 0.1f);
+    // Slivers starting at every offset inside a group, crossing tile borders
+    for (int offset = 0; offset < 4; ++offset) {
+        float x = 1.0f - (offset + 1.5f) * pixel;
+        addTriangle(mesh, x, -1.0f, 1.05f, -1.0f, x, 1.0f, -0.1f - 0.1f * offset);
+    }
+    // Overlapping triangle with a nearer depth, so the depth test matters
+    addTriangle(mesh, -0.2f, -1.1f, 1.1f, -1.1f, 1.1f, 1.1f, -0.5f);
+    return mesh;
+}
+
+int compare(int width, int height, unsigned threads) {
+    SoftwareUniforms uniforms;
+    uniforms.model = glm::mat4(1.0f);
+    uniforms.view = glm::mat4(1.0f);
+    uniforms.projection = glm::mat4(1.0f);
+    uniforms.lightDir = glm::vec3(0.0f, 0.0f, -1.0f);
+    uniforms.lightColor = glm::vec3(1.0f);
+    uniforms.objectColor = glm::vec3(0.6f, 0.6f, 1.0f);
+
+    Mesh mesh = createEdgeTriangles(width);
+    SoftwareRasterizer simd(width, height, threads, true);
+    SoftwareRasterizer scalar(width, height, 1, false);
+    for (SoftwareRasterizer* rasterizer : { &simd, &scalar }) {
+        rasterizer->clear();
+        rasterizer->draw(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), uniforms);
+    }
+
+    size_t bytes = static_cast<size_t>(width) * height * 4;
+    if (std::memcmp(simd.pixels(), scalar.pixels(), bytes) != 0) {
+        std::cerr << "ERROR::SOFTWARE_RASTERIZER_TEST::MISMATCH " << width << "x" << height << ", "
+                  << simd.threadCount() << " threads" << std::endl;
+        return 1;
+    }
+
+    // The corner pixels must actually be covered, or the test proves nothing
+    const unsigned char* lastRow = scalar.pixels() + static_cast<size_t>(height - 1) * width * 4;
+    const unsigned char* firstRow = scalar.pixels();
+    if (lastRow[(width - 1) * 4 + 3] != 255 || firstRow[(width - 1) * 4 + 3] != 255) {
+        std::cerr << "ERROR::SOFTWARE_RASTERIZER_TEST::CORNERS_NOT_COVERED " << width << "x" << height << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main() {
+    int failures = 0;
+    const int sizes[][2] = { { 800, 600 }, { 803, 601 }, { 130, 67 } };
+    for (const int* size : sizes) {
+        failures += compare(size[0], size[1], 1);
+        failures += compare(size[0], size[1], 4);
+    }
+    if (failures == 0) std::cout << "software rasterizer: SIMD matches scalar" << std::endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
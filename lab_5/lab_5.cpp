@@ -3,6 +3,12 @@
 #include <cmath>
 #include <iostream>
 #include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
 
 // ----------------------------------------------------
 // ЛОГИ И ВСПОМОГАТЕЛЬНЫЕ ФУНКЦИИ
@@ -61,6 +67,66 @@ struct Ray {
     Ray(const Vec3& o, const Vec3& d) : origin(o), direction(d.normalize()) {}
 };
 
+// ----------------------------------------------------
+// БЫСТРАЯ МАТЕМАТИКА ДЛЯ МАРШИРОВАНИЯ ПО ОБЪЁМУ
+// ----------------------------------------------------
+// Уровни точности calculateVolumetricLight. Погрешности — относительные, для
+// множителя пропускания; итоговое отличие картинки от Exact печатает --bench-math.
+enum class MathPrecision {
+    Exact,    // std::exp на каждом шаге
+    Fast      // табличная e^-x на каждом шаге: < 7.7e-6 за шаг, после n шагов < n * 7.7e-6
+};
+
+// Шагов марширования на луч: полное качество (окно, постер, бенчмарки) и
+// быстрый предпросмотр в окне, пока меняются параметры сцены
+static const int fullQualitySamples = 15;
+static const int previewSamples = 5;
+
+static const char* precisionName(MathPrecision precision) {
+    switch (precision) {
+        case MathPrecision::Fast: return "fast";
+        default:                  return "exact";
+    }
+}
+
+static bool parsePrecision(const std::string& name, MathPrecision& precision) {
+    if (name == "exact")     precision = MathPrecision::Exact;
+    else if (name == "fast") precision = MathPrecision::Fast;
+    else return false;
+    return true;
+}
+
+// e^-x по таблице: значения в узлах с шагом h = 1/128 на [0, 16] и линейная
+// интерполяция между ними. Таблица — 8 КБ, помещается в L1; вместо вызова
+// std::exp на шаге остаются умножение, два чтения и одно fma.
+// Интерполяция выпуклой e^-x всегда завышает значение, относительно не больше
+// чем на h^2 / 8 < 7.7e-6. За пределами таблицы пропускание уже < 1.2e-7 —
+// там просто std::exp.
+static const float tableExpMaxError = 7.7e-6f;
+
+struct ExpTable {
+    static const int perUnit = 128;
+    static const int range = 16;
+    static const int size = range * perUnit + 2;
+    float values[size];
+
+    ExpTable() {
+        for (int i = 0; i < size; ++i)
+            values[i] = std::exp(-static_cast<float>(i) / perUnit);
+    }
+};
+
+static const ExpTable expTable;
+
+static inline float tableExpNeg(float x) {
+    float scaled = x * ExpTable::perUnit;
+    if (!(scaled < ExpTable::range * ExpTable::perUnit)) return std::exp(-x);
+    int index = static_cast<int>(scaled);
+    float fraction = scaled - static_cast<float>(index);
+    float left = expTable.values[index];
+    return left + (expTable.values[index + 1] - left) * fraction;
+}
+
 // ----------------------------------------------------
 // ПЕРЕСЕЧЕНИЯ
 // ----------------------------------------------------
@@ -123,8 +189,11 @@ public:
     }
     
     float getDensity(const Vec3& point) const override {
-        float dist = (point - center).length();
-        if (dist > radius) return 0.0f;
+        // Большинство точек луча лежит вне сферы — для них корень не нужен
+        Vec3 offset = point - center;
+        float distSquared = offset.dot(offset);
+        if (distSquared > radius * radius) return 0.0f;
+        float dist = std::sqrt(distSquared);
         // Простая линейная модель распределения плотности внутри сферы
         return volumeDensity * (1.0f - dist / radius);
     }
@@ -195,16 +264,24 @@ public:
         objects.push_back(obj);
     }
     
-    // Основная функция для “объёмного” света
-    float calculateVolumetricLight(const Ray& ray, float maxDist, Vec3& outColor, int numSamples = 15) const {
+    // Основная функция для “объёмного” света.
+    // jitter в [0, 1) сдвигает все точки выборки на долю шага — так разные
+    // кадры временного кэша видят разные точки и их можно накапливать.
+    // outDepth (если задан) — расстояние вдоль луча, взвешенное по вкладу
+    // в свет: «глубина» пикселя для перепроецирования.
+    float calculateVolumetricLight(const Ray& ray, float maxDist, Vec3& outColor, int numSamples = fullQualitySamples,
+                                   MathPrecision precision = MathPrecision::Exact,
+                                   float jitter = 0.0f, float* outDepth = nullptr) const {
         // Чем больше numSamples, тем лучше качество, но медленнее рендер
         float stepSize = maxDist / numSamples;
         float totalLight = 0.0f;
         Vec3 accumulatedColor(0.0f, 0.0f, 0.0f);
         float transmittance = 1.0f;  // Коэффициент пропускания (эксп. затухание)
-        
+        float weightedDistance = 0.0f;
+
         for (int i = 0; i < numSamples; ++i) {
-            Vec3 samplePoint = ray.origin + ray.direction * (i * stepSize);
+            float sampleDistance = (i + jitter) * stepSize;
+            Vec3 samplePoint = ray.origin + ray.direction * sampleDistance;
             float density = 0.0f;
             Vec3 sampleColor(0.0f, 0.0f, 0.0f);
             
@@ -219,28 +296,34 @@ public:
             }
             
             if (density > 0) {
-                // Усреднённый цвет для данной точки
-                sampleColor = sampleColor / density;
-                
-                // Направление к источнику света
+                // Интенсивность, убывающая по квадрату расстояния до источника;
+                // само расстояние (и направление) не нужно — хватает d^2
                 Vec3 toLight = lightPos - samplePoint;
-                float distToLight = toLight.length();
-                toLight = toLight.normalize();
-                
-                // Интенсивность, убывающая по квадрату расстояния
-                float lightContribution = lightIntensity / (distToLight * distToLight);
+                float lightContribution = lightIntensity / toLight.dot(toLight);
                 
                 // Учитываем затухание света при прохождении через среду
-                float contribution = density * lightContribution * stepSize * transmittance;
+                float lightPerDensity = lightContribution * stepSize * transmittance;
+                float contribution = density * lightPerDensity;
                 totalLight += contribution;
+                weightedDistance += contribution * sampleDistance;
                 
-                // Накопленный цвет
-                accumulatedColor = accumulatedColor + sampleColor * contribution;
+                // Накопленный цвет: усреднённый цвет точки (sampleColor / density),
+                // умноженный на contribution, — плотность сокращается
+                Vec3 colorContribution = sampleColor * lightPerDensity;
+                accumulatedColor = accumulatedColor + colorContribution;
                 
                 // Экспоненциальное затухание: чем больше плотность, тем сильнее падает transmittance
-                transmittance *= std::exp(-density * stepSize);
+                float stepDepth = density * stepSize;
+                if (precision == MathPrecision::Exact) {
+                    transmittance *= std::exp(-stepDepth);
+                } else {
+                    transmittance *= tableExpNeg(stepDepth);
+                }
             }
         }
+
+        // Луч, не задевший среду, считаем уходящим на maxDist
+        if (outDepth) *outDepth = (totalLight > 1e-9f) ? weightedDistance / totalLight : maxDist;
         
         outColor = (totalLight > 1e-9f) ? (accumulatedColor / totalLight) : Vec3(0, 0, 0);
         return totalLight;
@@ -317,85 +400,961 @@ public:
     }
 };
 
+// ----------------------------------------------------
+// КАМЕРА
+// ----------------------------------------------------
+// Орбитальная камера: смотрит на target с расстояния distance;
+// yaw — поворот вокруг вертикали, pitch — наклон (в радианах).
+// При yaw = pitch = 0 базис совпадает с осями мира.
+struct Camera {
+    Vec3 position;
+    Vec3 right, up, forward;
+
+    static Camera orbit(const Vec3& target, float yaw, float pitch, float distance) {
+        float cosYaw = std::cos(yaw), sinYaw = std::sin(yaw);
+        float cosPitch = std::cos(pitch), sinPitch = std::sin(pitch);
+
+        Camera camera;
+        camera.forward  = Vec3(sinYaw * cosPitch, sinPitch, cosYaw * cosPitch);
+        camera.right    = Vec3(cosYaw, 0.0f, -sinYaw);
+        camera.up       = Vec3(-sinPitch * sinYaw, cosPitch, -sinPitch * cosYaw);
+        camera.position = target - camera.forward * distance;
+        return camera;
+    }
+
+    // Направление луча через пиксель (x, y)
+    Vec3 rayDirection(int x, int y, int width, int height) const {
+        float u = (2.0f * x - width) / static_cast<float>(height);
+        float v = (2.0f * y - height) / static_cast<float>(height);
+        return (right * u + up * v + forward).normalize();
+    }
+
+    // Обратная операция: точка мира -> непрерывные координаты пикселя.
+    // false, если точка позади камеры.
+    bool project(const Vec3& point, int width, int height, float& x, float& y) const {
+        Vec3 offset = point - position;
+        float z = offset.dot(forward);
+        if (z < 1e-4f) return false;
+        x = (offset.dot(right) / z * height + width) * 0.5f;
+        y = (offset.dot(up) / z * height + height) * 0.5f;
+        return true;
+    }
+};
+
+// Камера по умолчанию — прежняя неподвижная: (0, 0, -5), взгляд вдоль +z
+static const Vec3  cameraTarget(0.0f, 0.0f, 5.0f);
+static const float cameraDistance = 10.0f;
+
+// ----------------------------------------------------
+// ТРАССИРОВКА ОДНОГО ПИКСЕЛЯ
+// ----------------------------------------------------
+// Общая для окна и для постерного рендера, чтобы картинка не зависела от режима
+static Vec3 traceRadiance(const Scene& scene, const Camera& camera, int x, int y, int width, int height,
+                          int numSamples, MathPrecision precision, float jitter = 0.0f,
+                          float* depth = nullptr) {
+    Ray ray(camera.position, camera.rayDirection(x, y, width, height));
+    Vec3 pixelColor;
+
+    // Делать трассировку с объёмными эффектами
+    scene.calculateVolumetricLight(ray, 20.0f, pixelColor, numSamples, precision, jitter, depth);
+    return pixelColor;
+}
+
+// Преобразуем цвет в диапазон [0..255]
+static sf::Color toColor(const Vec3& color) {
+    uint8_t r = static_cast<uint8_t>(std::min(255.0f, color.x * 255.0f));
+    uint8_t g = static_cast<uint8_t>(std::min(255.0f, color.y * 255.0f));
+    uint8_t b = static_cast<uint8_t>(std::min(255.0f, color.z * 255.0f));
+    return sf::Color(r, g, b);
+}
+
+static sf::Color tracePixel(const Scene& scene, const Camera& camera,
+                            int x, int y, int width, int height, int numSamples,
+                            MathPrecision precision = MathPrecision::Exact) {
+    return toColor(traceRadiance(scene, camera, x, y, width, height, numSamples, precision));
+}
+
+// ----------------------------------------------------
+// ВРЕМЕННОЙ КЭШ (перепроецирование прошлого кадра)
+// ----------------------------------------------------
+// При движении камеры большая часть пикселей видна и в прошлом кадре, поэтому
+// они не трассируются заново, а берутся из него:
+//   1. каждый прошлый пиксель по своей глубине переносится в мир и
+//      проецируется в новый кадр — так получается оценка новой глубины
+//      (дыры в один пиксель заполняются ближайшим соседом);
+//   2. по этой глубине новый пиксель проецируется обратно в прошлый кадр и
+//      цвет берётся билинейно, если все четыре соседа там есть и их глубина
+//      согласуется с ожидаемой;
+//   3. заново трассируются только пиксели, для которых это не удалось
+//      (открывшиеся из-за края кадра или объекта), плюс 1/16 кадра по
+//      упорядоченной сетке 4x4 — чтобы ошибка перепроецирования не копилась.
+// Свежие выборки каждого кадра сдвинуты по лучу (jitter) и смешиваются с
+// историей как скользящее среднее; если свежий цвет слишком далёк от
+// истории, история отбрасывается.
+class TemporalCache {
+public:
+    struct FrameStats {
+        int pixels = 0;
+        int disoccluded = 0;  // не нашлось в прошлом кадре
+        int refreshed = 0;    // перепроецированы, но трассированы для обновления
+        int rejected = 0;     // из них история отброшена
+
+        float tracedPercent() const { return 100.0f * (disoccluded + refreshed) / pixels; }
+    };
+
+    // За столько кадров сетка обновления проходит каждый пиксель по разу
+    static constexpr int refreshInterval = 16;
+
+    TemporalCache(int width, int height)
+        : width_(width), height_(height),
+          current_(static_cast<size_t>(width) * height),
+          previous_(static_cast<size_t>(width) * height),
+          splatDepth_(static_cast<size_t>(width) * height),
+          directions_(static_cast<size_t>(width) * height),
+          previousDirections_(static_cast<size_t>(width) * height) {}
+
+    // Сцена изменилась — история больше не годится, следующий кадр полный
+    void invalidate() { valid_ = false; }
+
+    FrameStats render(const Scene& scene, const Camera& camera, int numSamples, MathPrecision precision,
+                      sf::Image& image) {
+        FrameStats stats;
+        stats.pixels = width_ * height_;
+
+        // Лучи кадра нужны и для перепроецирования, и (как прошлые) в следующем кадре
+        for (int y = 0; y < height_; ++y) {
+            for (int x = 0; x < width_; ++x) directions_[index(x, y)] = camera.rayDirection(x, y, width_, height_);
+        }
+
+        if (!valid_) {
+            // Полный кадр без сдвига — тот же, что без кэша
+            for (int y = 0; y < height_; ++y) {
+                for (int x = 0; x < width_; ++x) {
+                    CachedSample& sample = current_[index(x, y)];
+                    sample.color = traceRadiance(scene, camera, x, y, width_, height_, numSamples, precision,
+                                                 0.0f, &sample.depth);
+                    sample.history = 1;
+                    image.setPixel(x, y, toColor(sample.color));
+                }
+            }
+            stats.disoccluded = stats.pixels;
+            valid_ = true;
+            frameIndex_ = 0;
+            finishFrame(camera);
+            return stats;
+        }
+
+        ++frameIndex_;
+        // Пока камера движется, свежие выборки сдвинуты по лучу (сдвиги по
+        // последовательности золотого сечения равномерно покрывают шаг) и
+        // копятся в истории. Когда она остановилась, обновление трассирует без
+        // сдвига и заменяет историю — через refreshInterval кадров картинка
+        // совпадает с полной трассировкой.
+        bool moving = !sameCamera(camera, previousCamera_);
+        float jitter = 0.0f;
+        if (moving) {
+            jitter = frameIndex_ * 0.618034f;
+            jitter -= std::floor(jitter);
+            splatPreviousDepth(camera);
+        }
+
+        for (int y = 0; y < height_; ++y) {
+            for (int x = 0; x < width_; ++x) {
+                CachedSample& sample = current_[index(x, y)];
+                bool reprojected;
+                if (moving) {
+                    reprojected = reproject(camera, x, y, sample);
+                } else {
+                    sample = previous_[index(x, y)];
+                    reprojected = sample.history > 0;
+                }
+                bool refresh = reprojected && ((x & 3) + 4 * (y & 3)) == frameIndex_ % refreshInterval;
+
+                if (!reprojected || refresh) {
+                    float depth;
+                    Vec3 color = traceRadiance(scene, camera, x, y, width_, height_, numSamples, precision,
+                                               jitter, &depth);
+                    if (!reprojected) {
+                        ++stats.disoccluded;
+                        sample.color = color;
+                        sample.depth = depth;
+                        sample.history = 1;
+                    } else {
+                        ++stats.refreshed;
+                        Vec3 difference = color - sample.color;
+                        float largest = std::max({ std::abs(difference.x), std::abs(difference.y),
+                                                   std::abs(difference.z) });
+                        if (!moving) {
+                            sample.history = 0;
+                        } else if (largest > historyRejection) {
+                            ++stats.rejected;
+                            sample.history = 0;
+                        }
+                        sample.history = std::min(sample.history + 1, maxHistory);
+                        float weight = 1.0f / sample.history;
+                        sample.color = sample.color + difference * weight;
+                        sample.depth = sample.depth + (depth - sample.depth) * weight;
+                    }
+                }
+                image.setPixel(x, y, toColor(sample.color));
+            }
+        }
+
+        finishFrame(camera);
+        return stats;
+    }
+
+private:
+    struct CachedSample {
+        Vec3 color;
+        float depth = INFINITY;  // расстояние вдоль луча (см. calculateVolumetricLight)
+        int history = 0;         // сколько выборок накоплено; 0 — пусто
+    };
+
+    static constexpr int   maxHistory       = 8;     // предел скользящего среднего
+    static constexpr float historyRejection = 0.05f; // ~13/255 по любому каналу
+    static constexpr float depthTolerance   = 0.2f;  // относительное расхождение глубины
+
+    size_t index(int x, int y) const { return static_cast<size_t>(y) * width_ + x; }
+
+    static bool sameCamera(const Camera& a, const Camera& b) {
+        return a.position.x == b.position.x && a.position.y == b.position.y && a.position.z == b.position.z
+            && a.forward.x == b.forward.x && a.forward.y == b.forward.y && a.forward.z == b.forward.z;
+    }
+
+    // Шаг 1: прошлые пиксели -> новый кадр, в каждом пикселе ближайшая глубина
+    void splatPreviousDepth(const Camera& camera) {
+        std::fill(splatDepth_.begin(), splatDepth_.end(), INFINITY);
+        for (int y = 0; y < height_; ++y) {
+            for (int x = 0; x < width_; ++x) {
+                const CachedSample& sample = previous_[index(x, y)];
+                if (sample.history == 0) continue;
+
+                Vec3 point = previousCamera_.position + previousDirections_[index(x, y)] * sample.depth;
+                float px, py;
+                if (!camera.project(point, width_, height_, px, py)) continue;
+                int ix = static_cast<int>(std::floor(px + 0.5f));
+                int iy = static_cast<int>(std::floor(py + 0.5f));
+                if (ix < 0 || iy < 0 || ix >= width_ || iy >= height_) continue;
+
+                float& depth = splatDepth_[index(ix, iy)];
+                depth = std::min(depth, (point - camera.position).length());
+            }
+        }
+    }
+
+    // Шаг 2: новый пиксель -> прошлый кадр. false — пиксель нужно трассировать
+    bool reproject(const Camera& camera, int x, int y, CachedSample& out) const {
+        float depth = splatDepth_[index(x, y)];
+        if (depth == INFINITY) {
+            // Трещины при приближении камеры: берём ближайшего соседа
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = x + dx, ny = y + dy;
+                    if (nx < 0 || ny < 0 || nx >= width_ || ny >= height_) continue;
+                    depth = std::min(depth, splatDepth_[index(nx, ny)]);
+                }
+            }
+            if (depth == INFINITY) return false;
+        }
+
+        Vec3 point = camera.position + directions_[index(x, y)] * depth;
+        float px, py;
+        if (!previousCamera_.project(point, width_, height_, px, py)) return false;
+        // Пиксели стоят в целых координатах; за краем кадра — полпикселя запаса
+        if (px < -0.5f || py < -0.5f || px > width_ - 0.5f || py > height_ - 0.5f) return false;
+        int x0 = std::min(std::max(static_cast<int>(std::floor(px)), 0), width_ - 1);
+        int y0 = std::min(std::max(static_cast<int>(std::floor(py)), 0), height_ - 1);
+        int x1 = std::min(x0 + 1, width_ - 1);
+        int y1 = std::min(y0 + 1, height_ - 1);
+
+        float expectedDepth = (point - previousCamera_.position).length();
+        float fx = std::min(std::max(px - x0, 0.0f), 1.0f);
+        float fy = std::min(std::max(py - y0, 0.0f), 1.0f);
+        const float weights[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+        const CachedSample* taps[4] = { &previous_[index(x0, y0)], &previous_[index(x1, y0)],
+                                        &previous_[index(x0, y1)], &previous_[index(x1, y1)] };
+
+        Vec3 color(0.0f, 0.0f, 0.0f);
+        int history = maxHistory;
+        for (int i = 0; i < 4; ++i) {
+            if (taps[i]->history == 0) return false;
+            // Сосед из другого «слоя» (край сферы) — значит, пиксель открылся
+            if (std::abs(taps[i]->depth - expectedDepth) > depthTolerance * expectedDepth) return false;
+            color = color + taps[i]->color * weights[i];
+            history = std::min(history, taps[i]->history);
+        }
+
+        out.color = color;
+        out.depth = depth;
+        out.history = history;
+        return true;
+    }
+
+    void finishFrame(const Camera& camera) {
+        std::swap(current_, previous_);
+        std::swap(directions_, previousDirections_);
+        previousCamera_ = camera;
+    }
+
+    int width_, height_;
+    std::vector<CachedSample> current_, previous_;
+    std::vector<float> splatDepth_;
+    std::vector<Vec3> directions_, previousDirections_;
+    Camera previousCamera_;
+    bool valid_ = false;
+    int frameIndex_ = 0;
+};
+
+// ----------------------------------------------------
+// ТАЙЛОВЫЙ TIFF ДЛЯ ПОСТЕРНЫХ РАЗРЕШЕНИЙ
+// ----------------------------------------------------
+// Несжатый tiled TIFF (RGB, 8 бит на канал). Все тайлы одного размера, поэтому
+// смещение каждого тайла в файле известно заранее и готовый тайл пишется сразу
+// на своё место — в памяти никогда не держится больше одного тайла.
+// Если файл не помещается в 4 ГБ, автоматически пишется BigTIFF.
+class TiledTiffWriter {
+public:
+    TiledTiffWriter(const std::string& path, int width, int height, int tileSize, bool resume)
+        : width_(width), height_(height), tileSize_(tileSize) {
+        tilesAcross_ = (width + tileSize - 1) / tileSize;
+        tilesDown_   = (height + tileSize - 1) / tileSize;
+        tileBytes_   = static_cast<uint64_t>(tileSize) * tileSize * 3;
+
+        // Конец файла в обычной раскладке, вместе с таблицами TileOffsets и
+        // TileByteCounts (они растут на 8 байт за тайл): все 32-битные смещения
+        // должны оставаться меньше 2^32
+        uint64_t classicEnd = dataOffset() + tileBytes_ * tileCount();
+        bigTiff_ = classicEnd > (1ull << 32);
+
+        // При продолжении файл не обрезаем: готовые тайлы остаются на месте
+        auto mode = std::ios::in | std::ios::out | std::ios::binary;
+        if (resume) file_.open(path, mode);
+        if (!file_.is_open()) file_.open(path, mode | std::ios::trunc);
+        if (!file_.is_open()) {
+            log("Cannot open " + path + " for writing!");
+            return;
+        }
+        writeHeader();
+    }
+
+    bool isOpen() const { return file_.is_open() && file_.good(); }
+
+    int tilesAcross() const { return tilesAcross_; }
+    int tilesDown()   const { return tilesDown_; }
+    int tileCount()   const { return tilesAcross_ * tilesDown_; }
+    int tileSize()    const { return tileSize_; }
+
+    // rgb — tileSize*tileSize*3 байт; пиксели за краем картинки должны быть заполнены
+    void writeTile(int index, const std::vector<uint8_t>& rgb) {
+        file_.seekp(static_cast<std::streamoff>(tileOffset(index)));
+        file_.write(reinterpret_cast<const char*>(rgb.data()), static_cast<std::streamsize>(tileBytes_));
+        file_.flush();
+    }
+
+private:
+    // Типы полей TIFF
+    static constexpr uint16_t TYPE_SHORT = 3;
+    static constexpr uint16_t TYPE_LONG  = 4;
+    static constexpr uint16_t TYPE_LONG8 = 16;
+    static constexpr int      TAG_COUNT  = 11;
+
+    uint64_t headerSize() const { return bigTiff_ ? 16 : 8; }
+    uint64_t entrySize()  const { return bigTiff_ ? 20 : 12; }
+    uint64_t offsetSize() const { return bigTiff_ ? 8 : 4; }
+    uint64_t countSize()  const { return bigTiff_ ? 8 : 2; }
+    uint64_t ifdSize()    const { return countSize() + TAG_COUNT * entrySize() + offsetSize(); }
+
+    // Раскладка файла: заголовок, IFD, BitsPerSample, TileOffsets, TileByteCounts, тайлы
+    uint64_t bitsOffset()        const { return headerSize() + ifdSize(); }
+    uint64_t tileOffsetsOffset() const { return bitsOffset() + 8; }
+    uint64_t byteCountsOffset()  const { return tileOffsetsOffset() + tileCount() * offsetSize(); }
+    uint64_t dataOffset()        const { return (byteCountsOffset() + tileCount() * offsetSize() + 15) & ~15ull; }
+    uint64_t tileOffset(int index) const { return dataOffset() + index * tileBytes_; }
+
+    void put(uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) file_.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+
+    // Запись IFD: значения, не влезающие в поле записи, лежат по смещению
+    void putEntry(uint16_t tag, uint16_t type, uint64_t count, uint64_t value) {
+        put(tag, 2);
+        put(type, 2);
+        put(count, static_cast<int>(offsetSize()));
+        put(value, static_cast<int>(offsetSize()));
+    }
+
+    void writeHeader() {
+        file_.seekp(0);
+        file_.write("II", 2);  // little-endian
+        if (bigTiff_) {
+            put(43, 2);
+            put(8, 2);  // размер смещений
+            put(0, 2);
+        } else {
+            put(42, 2);
+        }
+        put(headerSize(), static_cast<int>(offsetSize()));
+
+        // Массивы из одного элемента обязаны лежать прямо в записи IFD
+        bool inlineArrays = tileCount() == 1;
+        uint16_t offsetType = bigTiff_ ? TYPE_LONG8 : TYPE_LONG;
+
+        put(TAG_COUNT, static_cast<int>(countSize()));
+        putEntry(256, TYPE_LONG,  1, width_);                    // ImageWidth
+        putEntry(257, TYPE_LONG,  1, height_);                   // ImageLength
+        putEntry(258, TYPE_SHORT, 3, bigTiff_ ? (8ull | 8ull << 16 | 8ull << 32) : bitsOffset()); // BitsPerSample
+        putEntry(259, TYPE_SHORT, 1, 1);                         // Compression: нет
+        putEntry(262, TYPE_SHORT, 1, 2);                         // Photometric: RGB
+        putEntry(277, TYPE_SHORT, 1, 3);                         // SamplesPerPixel
+        putEntry(284, TYPE_SHORT, 1, 1);                         // PlanarConfig: chunky
+        putEntry(322, TYPE_LONG,  1, tileSize_);                 // TileWidth
+        putEntry(323, TYPE_LONG,  1, tileSize_);                 // TileLength
+        putEntry(324, offsetType, tileCount(), inlineArrays ? tileOffset(0) : tileOffsetsOffset());
+        putEntry(325, offsetType, tileCount(), inlineArrays ? tileBytes_ : byteCountsOffset());
+        put(0, static_cast<int>(offsetSize()));                  // следующего IFD нет
+
+        put(8, 2); put(8, 2); put(8, 2); put(0, 2);
+
+        // Таблицы пишутся потоком, не собираясь в памяти целиком
+        if (!inlineArrays) {
+            for (int i = 0; i < tileCount(); ++i) put(tileOffset(i), static_cast<int>(offsetSize()));
+            for (int i = 0; i < tileCount(); ++i) put(tileBytes_, static_cast<int>(offsetSize()));
+        }
+        file_.flush();
+    }
+
+    std::fstream file_;
+    int width_, height_, tileSize_;
+    int tilesAcross_ = 0, tilesDown_ = 0;
+    uint64_t tileBytes_ = 0;
+    bool bigTiff_ = false;
+};
+
+// ----------------------------------------------------
+// ЖУРНАЛ ГОТОВЫХ ТАЙЛОВ (для продолжения прерванного рендера)
+// ----------------------------------------------------
+// Файл <out>.progress: заголовок с параметрами рендера и по одному байту на тайл.
+// Байт выставляется только после того, как тайл сброшен в TIFF.
+class TileJournal {
+public:
+    TileJournal(const std::string& path, int width, int height, int tileSize, int numSamples,
+                MathPrecision precision, int tileCount, bool resume)
+        : path_(path) {
+        const int32_t params[5] = { width, height, tileSize, numSamples, static_cast<int32_t>(precision) };
+        auto mode = std::ios::in | std::ios::out | std::ios::binary;
+
+        if (resume) {
+            file_.open(path, mode);
+            char magic[4] = {};
+            int32_t stored[5] = {};
+            file_.read(magic, 4);
+            file_.read(reinterpret_cast<char*>(stored), sizeof(stored));
+            resumed_ = file_.good() && std::equal(magic, magic + 4, MAGIC)
+                    && std::equal(stored, stored + 5, params);
+            if (!resumed_) {
+                log("No matching progress journal, starting from scratch.");
+                file_.close();
+            }
+        }
+        if (!resumed_) {
+            file_.open(path, mode | std::ios::trunc);
+            file_.write(MAGIC, 4);
+            file_.write(reinterpret_cast<const char*>(params), sizeof(params));
+            for (int i = 0; i < tileCount; ++i) file_.put(0);
+            file_.flush();
+        }
+        file_.clear();
+    }
+
+    bool resumed() const { return resumed_; }
+
+    bool isDone(int index) {
+        file_.seekg(HEADER_SIZE + index);
+        return file_.get() == 1;
+    }
+
+    void markDone(int index) {
+        file_.seekp(HEADER_SIZE + index);
+        file_.put(1);
+        file_.flush();
+    }
+
+    // Рендер завершён — журнал больше не нужен
+    void finish() {
+        file_.close();
+        std::remove(path_.c_str());
+    }
+
+private:
+    static constexpr const char* MAGIC = "L5T2";
+    static constexpr int HEADER_SIZE = 4 + 5 * sizeof(int32_t);
+
+    std::string path_;
+    std::fstream file_;
+    bool resumed_ = false;
+};
+
+// ----------------------------------------------------
+// ПОСТЕРНЫЙ РЕНДЕР
+// ----------------------------------------------------
+// Рендер по тайлам прямо в файл: пиковая память определяется размером тайла,
+// а не разрешением картинки.
+static int renderPoster(const Scene& scene, const Camera& camera, int width, int height,
+                        const std::string& outPath, int tileSize, int numSamples, bool resume,
+                        MathPrecision precision) {
+    ScopedTimer timer("Poster Render");
+    log("Poster render " + std::to_string(width) + "x" + std::to_string(height)
+        + " -> " + outPath + " (tile=" + std::to_string(tileSize)
+        + ", numSamples=" + std::to_string(numSamples) + ", precision=" + precisionName(precision) + ")");
+
+    // Продолжать можно, только если сам файл с готовыми тайлами на месте
+    resume = resume && std::ifstream(outPath).good();
+
+    TileJournal journal(outPath + ".progress", width, height, tileSize, numSamples, precision,
+                        ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize), resume);
+    TiledTiffWriter tiff(outPath, width, height, tileSize, journal.resumed());
+    if (!tiff.isOpen()) return 1;
+
+    std::vector<uint8_t> tile(static_cast<size_t>(tileSize) * tileSize * 3);
+    int skipped = 0;
+
+    for (int ty = 0; ty < tiff.tilesDown(); ++ty) {
+        for (int tx = 0; tx < tiff.tilesAcross(); ++tx) {
+            int index = ty * tiff.tilesAcross() + tx;
+            if (journal.isDone(index)) {
+                ++skipped;
+                continue;
+            }
+
+            std::fill(tile.begin(), tile.end(), 0);
+            int x0 = tx * tileSize, y0 = ty * tileSize;
+            int x1 = std::min(x0 + tileSize, width), y1 = std::min(y0 + tileSize, height);
+
+            for (int y = y0; y < y1; ++y) {
+                uint8_t* row = &tile[static_cast<size_t>(y - y0) * tileSize * 3];
+                for (int x = x0; x < x1; ++x) {
+                    sf::Color c = tracePixel(scene, camera, x, y, width, height, numSamples, precision);
+                    row[(x - x0) * 3 + 0] = c.r;
+                    row[(x - x0) * 3 + 1] = c.g;
+                    row[(x - x0) * 3 + 2] = c.b;
+                }
+            }
+
+            tiff.writeTile(index, tile);
+            if (!tiff.isOpen()) {
+                log("Write error, tile " + std::to_string(index) + " is not saved.");
+                return 1;
+            }
+            journal.markDone(index);
+        }
+        log("Tile row " + std::to_string(ty + 1) + "/" + std::to_string(tiff.tilesDown()) + " done.");
+    }
+
+    if (skipped > 0) log("Resumed: " + std::to_string(skipped) + " tiles were already rendered.");
+    journal.finish();
+    log("Poster saved to " + outPath);
+    return 0;
+}
+
+// ----------------------------------------------------
+// СРАВНЕНИЕ УРОВНЕЙ ТОЧНОСТИ
+// ----------------------------------------------------
+// Рендерит кадр во всех режимах MathPrecision и сравнивает с Exact:
+// время на один шаг марширования, относительную погрешность света и цвета
+// и отличие итоговых 8-битных цветов.
+// Режимы чередуются в нескольких раундах, берётся лучшее время — так
+// меньше влияют частота процессора и соседние процессы.
+// Возвращает 1, если режим вышел за свои пределы погрешности (см. MathPrecision):
+//   свет  — максимум < n * ε, среднее < n * ε / 2 (ε — погрешность экспоненты за шаг;
+//           ошибки шагов одного знака и складываются, но в среднем по ячейке
+//           таблицы это 2ε/3, а вклад шага i несёт ошибку только i шагов);
+//   цвет  — это отношение двух сумм, поэтому вдвое больше: < 2n * ε и < n * ε;
+//   8 бит — не больше 1/255 (погрешность цвета меньше одного уровня).
+static int runMathBenchmark(const Scene& scene, const Camera& camera, int width, int height, int numSamples) {
+    const MathPrecision precisions[] = { MathPrecision::Exact, MathPrecision::Fast };
+    const float stepErrors[] = { 0.0f, tableExpMaxError };
+    const int precisionCount = 2;
+    const int rounds = 5;
+    // Запас на округления float при суммировании
+    const double roundingSlack = 1e-5;
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    std::vector<float> lights[precisionCount];
+    std::vector<Vec3> colors[precisionCount];
+    double bestSeconds[precisionCount];
+
+    log("Math benchmark " + std::to_string(width) + "x" + std::to_string(height)
+        + ", numSamples=" + std::to_string(numSamples));
+
+    for (int p = 0; p < precisionCount; ++p) {
+        lights[p].resize(pixelCount);
+        colors[p].resize(pixelCount);
+        bestSeconds[p] = INFINITY;
+    }
+
+    for (int round = 0; round < rounds; ++round) {
+        for (int p = 0; p < precisionCount; ++p) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    size_t index = static_cast<size_t>(y) * width + x;
+                    Ray ray(camera.position, camera.rayDirection(x, y, width, height));
+                    lights[p][index] = scene.calculateVolumetricLight(ray, 20.0f, colors[p][index], numSamples,
+                                                                      precisions[p]);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            bestSeconds[p] = std::min(bestSeconds[p], seconds);
+        }
+    }
+
+    int failures = 0;
+    for (int p = 0; p < precisionCount; ++p) {
+        double maxLightError = 0.0, sumLightError = 0.0;
+        double maxColorError = 0.0, sumColorError = 0.0;
+        size_t litPixels = 0;
+        int maxDifference = 0;
+        size_t differentPixels = 0;
+        for (size_t i = 0; i < pixelCount; ++i) {
+            sf::Color color = toColor(colors[p][i]);
+            sf::Color reference = toColor(colors[0][i]);
+            int difference = std::max({ std::abs(color.r - reference.r),
+                                        std::abs(color.g - reference.g),
+                                        std::abs(color.b - reference.b) });
+            maxDifference = std::max(maxDifference, difference);
+            if (difference > 0) ++differentPixels;
+
+            // Лучи мимо среды дают ноль в обоих режимах
+            float exactLight = lights[0][i];
+            if (exactLight <= 1e-9f) continue;
+            ++litPixels;
+            double lightError = std::fabs(lights[p][i] - exactLight) / exactLight;
+            const Vec3& exact = colors[0][i];
+            double colorError = std::max({ std::fabs(colors[p][i].x - exact.x) / std::max(exact.x, 1e-6f),
+                                           std::fabs(colors[p][i].y - exact.y) / std::max(exact.y, 1e-6f),
+                                           std::fabs(colors[p][i].z - exact.z) / std::max(exact.z, 1e-6f) });
+            maxLightError = std::max(maxLightError, lightError);
+            maxColorError = std::max(maxColorError, colorError);
+            sumLightError += lightError;
+            sumColorError += colorError;
+        }
+        double meanLightError = litPixels ? sumLightError / litPixels : 0.0;
+        double meanColorError = litPixels ? sumColorError / litPixels : 0.0;
+
+        std::printf("[MATH] %-5s %8.1f ms  %6.2f ns/sample  light err max %.2e mean %.2e  "
+                    "color err max %.2e mean %.2e  max diff %d/255, %zu pixels differ\n",
+                    precisionName(precisions[p]), bestSeconds[p] * 1000.0,
+                    bestSeconds[p] * 1e9 / (static_cast<double>(pixelCount) * numSamples),
+                    maxLightError, meanLightError, maxColorError, meanColorError, maxDifference, differentPixels);
+
+        double lightLimit = numSamples * stepErrors[p] + roundingSlack;
+        double meanLightLimit = numSamples * stepErrors[p] / 2.0 + roundingSlack;
+        bool withinLimits = maxLightError <= lightLimit && meanLightError <= meanLightLimit
+                         && maxColorError <= 2.0 * lightLimit && meanColorError <= 2.0 * meanLightLimit
+                         && maxDifference <= 1;
+        if (!withinLimits) {
+            char limits[128];
+            std::snprintf(limits, sizeof(limits), "light max %.2e mean %.2e, color max %.2e mean %.2e, diff 1/255",
+                          lightLimit, meanLightLimit, 2.0 * lightLimit, 2.0 * meanLightLimit);
+            log(std::string("Precision ") + precisionName(precisions[p]) + " exceeds its error limits: " + limits);
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// ----------------------------------------------------
+// ДВИЖЕНИЕ КАМЕРЫ С ВРЕМЕННЫМ КЭШЕМ
+// ----------------------------------------------------
+// Облетает сцену небольшими шагами (как при удержании стрелок в окне) и
+// для каждого кадра сравнивает кэш с полной трассировкой: долю заново
+// трассированных пикселей, время и отличие картинки. После остановки —
+// ещё refreshInterval кадров дообновления, как в окне. В итоге — среднее
+// и худшее отличие за время движения и отличие после дообновления.
+static int runCameraBenchmark(const Scene& scene, int width, int height, int numSamples, int frames,
+                              MathPrecision precision) {
+    const float yawStep = 0.5f * 3.14159265f / 180.0f;
+    const float dollyStep = 0.02f;
+
+    TemporalCache cache(width, height);
+    sf::Image cached, reference;
+    cached.create(width, height);
+    reference.create(width, height);
+
+    log("Camera benchmark " + std::to_string(width) + "x" + std::to_string(height) + ", "
+        + std::to_string(frames) + " frames, numSamples=" + std::to_string(numSamples)
+        + ", precision=" + precisionName(precision));
+
+    double cachedTotal = 0.0, fullTotal = 0.0, tracedTotal = 0.0, meanDifferenceTotal = 0.0;
+    int worstDifference = 0;
+    double settledMeanDifference = 0.0;
+    int settledMaxDifference = 0;
+    for (int frame = 0; frame <= frames + TemporalCache::refreshInterval; ++frame) {
+        int step = std::min(frame, frames);
+        Camera camera = Camera::orbit(cameraTarget, step * yawStep, 0.5f * step * yawStep,
+                                      cameraDistance - step * dollyStep);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        TemporalCache::FrameStats stats = cache.render(scene, camera, numSamples, precision, cached);
+        double cachedSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                reference.setPixel(x, y, tracePixel(scene, camera, x, y, width, height, numSamples, precision));
+            }
+        }
+        double fullSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        int maxDifference = 0;
+        double sumDifference = 0.0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                sf::Color a = cached.getPixel(x, y), b = reference.getPixel(x, y);
+                int difference = std::max({ std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b) });
+                maxDifference = std::max(maxDifference, difference);
+                sumDifference += difference;
+            }
+        }
+
+        double meanDifference = sumDifference / (static_cast<double>(width) * height);
+        std::printf("[CAMERA] frame %3d: re-traced %5.1f%% (disoccluded %4.1f%%, refreshed %4.1f%%, rejected %d)"
+                    "  %6.1f ms vs full %6.1f ms  diff mean %.2f max %d /255\n",
+                    frame, stats.tracedPercent(), 100.0f * stats.disoccluded / stats.pixels,
+                    100.0f * stats.refreshed / stats.pixels, stats.rejected,
+                    cachedSeconds * 1000.0, fullSeconds * 1000.0, meanDifference, maxDifference);
+
+        // Первый кадр всегда полный — в среднее не входит, как и дообновление
+        if (frame > 0 && frame <= frames) {
+            cachedTotal += cachedSeconds;
+            fullTotal += fullSeconds;
+            tracedTotal += stats.tracedPercent();
+            meanDifferenceTotal += meanDifference;
+            worstDifference = std::max(worstDifference, maxDifference);
+        }
+        settledMeanDifference = meanDifference;
+        settledMaxDifference = maxDifference;
+    }
+
+    if (frames > 0) {
+        std::printf("[CAMERA] average: re-traced %.1f%%, %.1f ms vs full %.1f ms per frame, "
+                    "diff mean %.2f max %d /255 (worst frame)\n",
+                    tracedTotal / frames, cachedTotal * 1000.0 / frames, fullTotal * 1000.0 / frames,
+                    meanDifferenceTotal / frames, worstDifference);
+    }
+    std::printf("[CAMERA] settled: diff mean %.2f max %d /255\n", settledMeanDifference, settledMaxDifference);
+    return 0;
+}
+
+// Сцена с двумя сферами и одной плоскостью (точно по заданию)
+static void populateScene(Scene& scene) {
+    // Две сферы (как требуется в задании)
+    scene.addObject(new Sphere(Vec3(-1.5f, 0.0f, 5.0f), 1.0f, 0.1f, Vec3(1.0f, 0.2f, 0.2f))); // первая сфера
+    scene.addObject(new Sphere(Vec3(1.5f, 0.0f, 5.0f), 1.0f, 0.1f, Vec3(0.2f, 1.0f, 0.2f)));  // вторая сфера
+
+    // Одна плоскость (как требуется в задании)
+    scene.addObject(new Plane(Vec3(0.0f, 1.0f, 0.0f), 2.0f, 0.02f, Vec3(0.5f, 0.5f, 1.0f))); // плоскость
+
+    log("Scene created: 2 spheres, 1 plane (as per requirements).");
+}
+
 // ----------------------------------------------------
 // ОСНОВНАЯ ФУНКЦИЯ
 // ----------------------------------------------------
-int main() {
+// Режимы запуска; при неизвестном ключе печатается этот текст и main возвращает 1
+static const char* const usage =
+    "Usage:\n"
+    "  lab_5 [--precision exact|fast]\n"
+    "      interactive window: arrows orbit the camera, W/S and the mouse wheel zoom\n"
+    "  lab_5 --bench-camera [--frames N] [--samples N] [--precision P]\n"
+    "      camera flight with the temporal cache against full tracing\n"
+    "  lab_5 --poster <width> <height> <out.tif> [--tile N] [--samples N] [--resume] [--precision P]\n"
+    "      poster render without a window\n"
+    "  lab_5 --bench-math [--samples N] [--size WxH]\n"
+    "      speed and error of every precision tier against exact\n";
+
+static int rejectArgument(const std::string& arg) {
+    log("Unknown argument: " + arg);
+    std::cerr << usage;
+    return 1;
+}
+
+int main(int argc, char** argv) {
     log("Starting application...");
 
+    Scene scene(Vec3(5.0f, 5.0f, 5.0f), 50.0f);
+    populateScene(scene);
+
+    // Камера на орбите; по умолчанию — в точке (0, 0, -5)
+    float cameraYaw = 0.0f, cameraPitch = 0.0f, cameraZoom = cameraDistance;
+    Camera camera = Camera::orbit(cameraTarget, cameraYaw, cameraPitch, cameraZoom);
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-math") {
+        int numSamples = fullQualitySamples;
+        int width = 800, height = 600;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--samples" && i + 1 < argc) numSamples = std::atoi(argv[++i]);
+            else if (arg == "--size" && i + 1 < argc) {
+                // Уменьшенный кадр — для проверки погрешности в ctest
+                if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    log("Invalid frame size.");
+                    return 1;
+                }
+            }
+            else return rejectArgument(arg);
+        }
+        if (numSamples <= 0) {
+            log("Invalid number of samples.");
+            return 1;
+        }
+        return runMathBenchmark(scene, camera, width, height, numSamples);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-camera") {
+        int numSamples = fullQualitySamples;
+        int frames = 30;
+        MathPrecision precision = MathPrecision::Exact;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--samples" && i + 1 < argc)     numSamples = std::atoi(argv[++i]);
+            else if (arg == "--frames" && i + 1 < argc) frames = std::atoi(argv[++i]);
+            else if (arg == "--precision" && i + 1 < argc) {
+                if (!parsePrecision(argv[++i], precision)) {
+                    log("Unknown precision: " + std::string(argv[i]) + " (expected exact or fast)");
+                    return 1;
+                }
+            }
+            else return rejectArgument(arg);
+        }
+        if (numSamples <= 0 || frames < 0) {
+            log("Invalid number of samples or frames.");
+            return 1;
+        }
+        return runCameraBenchmark(scene, 800, 600, numSamples, frames, precision);
+    }
+
+    if (argc >= 5 && std::string(argv[1]) == "--poster") {
+        int posterWidth  = std::atoi(argv[2]);
+        int posterHeight = std::atoi(argv[3]);
+        std::string outPath = argv[4];
+        int tileSize = 256;
+        int numSamples = fullQualitySamples;
+        bool resume = false;
+        MathPrecision precision = MathPrecision::Exact;
+
+        for (int i = 5; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--tile" && i + 1 < argc)         tileSize = std::atoi(argv[++i]);
+            else if (arg == "--samples" && i + 1 < argc) numSamples = std::atoi(argv[++i]);
+            else if (arg == "--resume")                  resume = true;
+            else if (arg == "--precision" && i + 1 < argc) {
+                if (!parsePrecision(argv[++i], precision)) {
+                    log("Unknown precision: " + std::string(argv[i]) + " (expected exact or fast)");
+                    return 1;
+                }
+            }
+            else return rejectArgument(arg);
+        }
+
+        // TIFF требует, чтобы размер тайла был кратен 16
+        if (posterWidth <= 0 || posterHeight <= 0 || tileSize <= 0 || tileSize % 16 != 0 || numSamples <= 0) {
+            log("Invalid poster parameters (tile size must be a positive multiple of 16).");
+            return 1;
+        }
+        return renderPoster(scene, camera, posterWidth, posterHeight, outPath, tileSize, numSamples, resume,
+                            precision);
+    }
+
+    MathPrecision precision = MathPrecision::Exact;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--precision" && i + 1 < argc) {
+            if (!parsePrecision(argv[++i], precision)) {
+                log("Unknown precision: " + std::string(argv[i]) + " (expected exact or fast)");
+                return 1;
+            }
+        }
+        else return rejectArgument(arg);
+    }
+
     const int WIDTH  = 800;
     const int HEIGHT = 600;
-    
+
     // Создаём окно
     sf::RenderWindow window(sf::VideoMode(WIDTH, HEIGHT), "Ray Tracing + Volumetric Light (No OpenMP)");
     window.setFramerateLimit(30); // ограничим FPS до 30 для стабильности
-    
+
     // Подготовим объекты SFML для вывода
     sf::Image   image;
     sf::Texture texture;
     sf::Sprite  sprite;
     image.create(WIDTH, HEIGHT);
-    
-    log("Created SFML window with size: " + std::to_string(WIDTH) + "x" + std::to_string(HEIGHT));
-    
-    // Создаём сцену с двумя сферами и одной плоскостью (точно по заданию)
-    Scene scene(Vec3(5.0f, 5.0f, 5.0f), 50.0f);
 
-    // Две сферы (как требуется в задании)
-    scene.addObject(new Sphere(Vec3(-1.5f, 0.0f, 5.0f), 1.0f, 0.1f, Vec3(1.0f, 0.2f, 0.2f))); // первая сфера
-    scene.addObject(new Sphere(Vec3(1.5f, 0.0f, 5.0f), 1.0f, 0.1f, Vec3(0.2f, 1.0f, 0.2f)));  // вторая сфера
+    log("Created SFML window with size: " + std::to_string(WIDTH) + "x" + std::to_string(HEIGHT));
 
-    // Одна плоскость (как требуется в задании)
-    scene.addObject(new Plane(Vec3(0.0f, 1.0f, 0.0f), 2.0f, 0.02f, Vec3(0.5f, 0.5f, 1.0f))); // плоскость
+    // Все кадры идут через кэш: после изменения сцены он сбрасывается и
+    // трассирует кадр целиком, при движении камеры — только часть пикселей
+    TemporalCache cache(WIDTH, HEIGHT);
 
-    log("Scene created: 2 spheres, 1 plane (as per requirements).");
-    
-    // Позиция камеры
-    Vec3 cameraPos(0.0f, 0.0f, -5.0f);
-    
     // ------------------------------------------------
     // Функция для рендеринга
     // ------------------------------------------------
-    auto renderScene = [&](int numSamples = 15) {
+    auto renderScene = [&](int numSamples) {
         ScopedTimer timer("Render Scene");  // автоматический вывод времени
-        log("Rendering scene... (numSamples=" + std::to_string(numSamples) + ")");
-        
+        log("Rendering scene... (numSamples=" + std::to_string(numSamples)
+            + ", precision=" + precisionName(precision) + ")");
+
         // Полный проход по каждому пикселю — однопоточный
-        for (int y = 0; y < HEIGHT; ++y) {
-            for (int x = 0; x < WIDTH; ++x) {
-                float u = (2.0f * x - WIDTH) / static_cast<float>(HEIGHT);
-                float v = (2.0f * y - HEIGHT) / static_cast<float>(HEIGHT);
-                
-                Ray ray(cameraPos, Vec3(u, v, 1.0f).normalize());
-                Vec3 pixelColor;
-                
-                // Делать трассировку с объёмными эффектами
-                scene.calculateVolumetricLight(ray, 20.0f, pixelColor, numSamples);
-                
-                // Преобразуем цвет в диапазон [0..255]
-                uint8_t r = static_cast<uint8_t>(std::min(255.0f, pixelColor.x * 255.0f));
-                uint8_t g = static_cast<uint8_t>(std::min(255.0f, pixelColor.y * 255.0f));
-                uint8_t b = static_cast<uint8_t>(std::min(255.0f, pixelColor.z * 255.0f));
-                
-                // Записываем в картинку
-                image.setPixel(x, y, sf::Color(r, g, b));
-            }
-        }
+        cache.invalidate();
+        cache.render(scene, camera, numSamples, precision, image);
+        // Предпросмотр с меньшим числом шагов не должен попасть в историю:
+        // иначе следующий кадр камеры смешал бы его с полными выборками
+        if (numSamples != fullQualitySamples) cache.invalidate();
         texture.loadFromImage(image);
         sprite.setTexture(texture);
         
         log("Scene render complete.");
     };
+
+    // Кадр при движении камеры: перепроецирование прошлого кадра
+    auto renderCameraFrame = [&]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        TemporalCache::FrameStats stats = cache.render(scene, camera, fullQualitySamples, precision, image);
+        texture.loadFromImage(image);
+        sprite.setTexture(texture);
+
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        char message[160];
+        std::snprintf(message, sizeof(message),
+                      "Camera frame: re-traced %.1f%% of pixels (disoccluded %.1f%%, refreshed %.1f%%), %lld ms",
+                      stats.tracedPercent(), 100.0f * stats.disoccluded / stats.pixels,
+                      100.0f * stats.refreshed / stats.pixels, static_cast<long long>(duration));
+        log(message);
+    };
+
+    const float orbitSpeed = 1.0f;   // рад/с
+    const float dollySpeed = 4.0f;   // единиц/с
+    // После остановки камеры кэш ещё дообновляет картинку, пока сетка
+    // обновления не пройдёт каждый пиксель
+    int settleFramesLeft = 0;
+    sf::Clock frameClock;
     
     // Первый рендер (полноценный)
-    renderScene(15);
+    renderScene(fullQualitySamples);
     
     // ------------------------------------------------
     // ОСНОВНОЙ ЦИКЛ
     // ------------------------------------------------
+    float wheelDelta = 0.0f;
     while (window.isOpen()) {
         sf::Event event;
         while (window.pollEvent(event)) {
+            if (event.type == sf::Event::MouseWheelScrolled) {
+                wheelDelta -= event.mouseWheelScroll.delta * 0.5f;
+            }
+
             if (event.type == sf::Event::Closed 
              || (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)) {
                 log("Closing application...");
@@ -448,7 +1407,7 @@ int main() {
                 
                 if (needsUpdate) {
                     log("Changes detected, rendering preview...");
-                    renderScene(5); // Быстрый предпросмотр
+                    renderScene(previewSamples); // Быстрый предпросмотр
                 }
             }
             
@@ -462,10 +1421,36 @@ int main() {
                  event.key.code == sf::Keyboard::B)) {
                 
                 log("Performing full quality render...");
-                renderScene(15); // Полное качество
+                renderScene(fullQualitySamples); // Полное качество
             }
         }
         
+        // Камера: удерживаемые клавиши двигают её непрерывно
+        float dt = std::min(frameClock.restart().asSeconds(), 0.1f);
+        float yawDelta = 0.0f, pitchDelta = 0.0f, zoomDelta = wheelDelta;
+        wheelDelta = 0.0f;
+        if (window.hasFocus()) {
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left))  yawDelta   -= orbitSpeed * dt;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right)) yawDelta   += orbitSpeed * dt;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up))    pitchDelta += orbitSpeed * dt;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down))  pitchDelta -= orbitSpeed * dt;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::W))     zoomDelta  -= dollySpeed * dt;
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::S))     zoomDelta  += dollySpeed * dt;
+        }
+
+        if (yawDelta != 0.0f || pitchDelta != 0.0f || zoomDelta != 0.0f) {
+            cameraYaw += yawDelta;
+            cameraPitch = std::max(-1.4f, std::min(1.4f, cameraPitch + pitchDelta));
+            cameraZoom = std::max(2.0f, std::min(30.0f, cameraZoom + zoomDelta));
+            camera = Camera::orbit(cameraTarget, cameraYaw, cameraPitch, cameraZoom);
+            renderCameraFrame();
+            settleFramesLeft = TemporalCache::refreshInterval;
+        }
+        else if (settleFramesLeft > 0) {
+            --settleFramesLeft;
+            renderCameraFrame();
+        }
+        
         // Рисуем результат
         window.clear();
         window.draw(sprite);